@@ -10,6 +10,9 @@ which all pass the params to 'r_c_shortest_paths_dispatch'.
 
 My approach is to call directly a 'r_c_shortest_paths_dispatch_adapted'
 with all the parameters specified
+
+Another addition: 'r_c_shortest_paths_workspace' keeps the queue, the label lists of the vertices
+and the memory of the labels between consecutive calls, so they get cleared instead of reallocated
 */
 
 #ifndef H_GRAPH_R_C_SHORTEST_PATHS
@@ -24,6 +27,95 @@ with all the parameters specified
 namespace boost {
 
 	namespace detail {
+		/// Buffers of r_c_shortest_paths_dispatch_adapted, which preserve their capacity between calls
+		template<class Graph,
+		class Resource_Container,
+		class Label_Allocator = std::allocator< r_c_shortest_paths_label< Graph, Resource_Container > > >
+			class r_c_shortest_paths_workspace {
+			public:
+				typedef r_c_shortest_paths_label< Graph, Resource_Container > Label;
+				typedef typename Label_Allocator::template rebind< Label >::other LAlloc;
+				typedef ks_smart_pointer< Label > Splabel;
+				typedef typename std::list< Splabel >::iterator LabelsIter;
+
+				/// priority_queue exposing its container, to be able to reuse it
+				class LabelsQueue : public std::priority_queue< Splabel, std::vector< Splabel >, std::greater< Splabel > > {
+				public:
+					std::vector< Splabel >& container() { return this->c; }
+				};
+
+				LabelsQueue unprocessed_labels;
+				std::vector< std::list< Splabel > > vec_vertex_labels;
+				std::vector< LabelsIter > vec_last_valid_positions_for_dominance;
+				std::vector< size_t > vec_last_valid_index_for_dominance;
+				std::vector< bool > b_vec_vertex_already_checked_for_dominance;
+
+				r_c_shortest_paths_workspace() {}
+
+				~r_c_shortest_paths_workspace() {
+					for( Label *l : spare_labels )
+						l_alloc.deallocate( l, 1 );
+				}
+
+				/// Empties the buffers and prepares them for a graph with verticesCount vertices
+				void reset( size_t verticesCount ) {
+					unprocessed_labels.container().clear();
+					for( std::list< Splabel > &labels : vec_vertex_labels )
+						spare_list_nodes.splice( spare_list_nodes.end(), labels );
+					vec_vertex_labels.resize( verticesCount );
+					vec_last_valid_positions_for_dominance.resize( verticesCount );
+					for( size_t i = 0; i < verticesCount; ++i )
+						vec_last_valid_positions_for_dominance[i] = vec_vertex_labels[i].begin();
+					vec_last_valid_index_for_dominance.assign( verticesCount, 0 );
+					b_vec_vertex_already_checked_for_dominance.assign( verticesCount, false );
+				}
+
+				/// Creates a label within the memory of a previously deleted label, if available
+				Label* new_label( const Label &proto ) {
+					Label *l = nullptr;
+					if( spare_labels.empty() )
+						l = l_alloc.allocate( 1 );
+					else {
+						l = spare_labels.back();
+						spare_labels.pop_back();
+					}
+					l_alloc.construct( l, proto );
+					return l;
+				}
+
+				/// Destroys the label, but keeps its memory for the next labels
+				void delete_label( Label *l ) {
+					l_alloc.destroy( l );
+					spare_labels.push_back( l );
+				}
+
+				/// Appends l to labels using a spare list node, if available
+				void push_label( std::list< Splabel > &labels, const Splabel &l ) {
+					if( spare_list_nodes.empty() )
+						labels.push_back( l );
+					else {
+						labels.splice( labels.end(), spare_list_nodes, spare_list_nodes.begin() );
+						labels.back() = l;
+					}
+				}
+
+				/// Removes the node pointed by it from labels, keeping the node for later. Returns the next iterator
+				LabelsIter erase_label( std::list< Splabel > &labels, LabelsIter it ) {
+					LabelsIter next = it;
+					++next;
+					spare_list_nodes.splice( spare_list_nodes.end(), labels, it );
+					return next;
+				}
+
+			private:
+				LAlloc l_alloc;
+				std::vector< Label* > spare_labels;		///< memory of the destroyed labels
+				std::list< Splabel > spare_list_nodes;	///< nodes removed from vec_vertex_labels
+
+				r_c_shortest_paths_workspace( const r_c_shortest_paths_workspace& ) = delete;
+				r_c_shortest_paths_workspace& operator=( const r_c_shortest_paths_workspace& ) = delete;
+		};
+
 		// r_c_shortest_paths_dispatch_adapted function (body/implementation)
 		template<class Graph, 
 		class VertexIndexMap, 
@@ -48,36 +140,35 @@ namespace boost {
 					const Resource_Container& rc, 
 					Resource_Extension_Function& ref, 
 					Dominance_Function& dominance, 
-					// to specify the memory management strategy for the labels
-					Label_Allocator /*la*/, 
+					// the buffers to be used, which also specify the memory management strategy for the labels
+					r_c_shortest_paths_workspace< Graph, Resource_Container, Label_Allocator > &ws, 
 					Visitor vis )
 		{
 			typedef typename boost::graph_traits<Graph>::vertices_size_type  vertices_size_type;
 
-			typedef typename Label_Allocator::template rebind< r_c_shortest_paths_label< Graph, Resource_Container > >::other LAlloc;
-			typedef ks_smart_pointer< r_c_shortest_paths_label< Graph, Resource_Container > > Splabel;
+			typedef typename r_c_shortest_paths_workspace< Graph, Resource_Container, Label_Allocator >::Splabel Splabel;
 
 			pareto_optimal_resource_containers.clear();
 			pareto_optimal_solutions.clear();
 
+			ws.reset( (size_t)num_vertices( g ) );
+
 			size_t i_label_num = 0;
-			LAlloc l_alloc;
-			std::priority_queue< Splabel, std::vector< Splabel >, std::greater< Splabel > >   unprocessed_labels;
+			typename r_c_shortest_paths_workspace< Graph, Resource_Container, Label_Allocator >::LabelsQueue
+				&unprocessed_labels = ws.unprocessed_labels;
 
 			bool b_feasible = true;
-			r_c_shortest_paths_label<Graph, Resource_Container>* first_label = l_alloc.allocate( 1 );
-			l_alloc.construct(first_label, r_c_shortest_paths_label< Graph, Resource_Container >(
+			r_c_shortest_paths_label<Graph, Resource_Container>* first_label = ws.new_label( r_c_shortest_paths_label< Graph, Resource_Container >(
 									(unsigned long)i_label_num++, rc, 0, typename graph_traits<Graph>::edge_descriptor(), s ) );
 
 			Splabel splabel_first_label = Splabel( first_label );
 			unprocessed_labels.push( splabel_first_label );
-			std::vector<std::list<Splabel> > vec_vertex_labels( num_vertices( g ) );
-			vec_vertex_labels[size_t(vertex_index_map[size_t(s)])].push_back( splabel_first_label );
-			std::vector<typename std::list<Splabel>::iterator>  vec_last_valid_positions_for_dominance( num_vertices( g ) );
-			for( vertices_size_type i = 0; i < num_vertices( g ); ++i )
-				vec_last_valid_positions_for_dominance[i] = vec_vertex_labels[i].begin();
-			std::vector<size_t> vec_last_valid_index_for_dominance( num_vertices( g ), 0 );
-			std::vector<bool> b_vec_vertex_already_checked_for_dominance( num_vertices( g ), false );
+			std::vector<std::list<Splabel> > &vec_vertex_labels = ws.vec_vertex_labels;
+			ws.push_label( vec_vertex_labels[size_t(vertex_index_map[size_t(s)])], splabel_first_label );
+			std::vector<typename std::list<Splabel>::iterator> &vec_last_valid_positions_for_dominance = ws.vec_last_valid_positions_for_dominance;
+			vec_last_valid_positions_for_dominance[size_t(vertex_index_map[size_t(s)])] = vec_vertex_labels[size_t(vertex_index_map[size_t(s)])].begin();
+			std::vector<size_t> &vec_last_valid_index_for_dominance = ws.vec_last_valid_index_for_dominance;
+			std::vector<bool> &b_vec_vertex_already_checked_for_dominance = ws.b_vec_vertex_already_checked_for_dominance;
 			
 			while( !unprocessed_labels.empty()  && vis.on_enter_loop(unprocessed_labels, g) ) {
 				Splabel cur_label = unprocessed_labels.top();
@@ -136,14 +227,11 @@ namespace boost {
 																cur_inner_splabel->cumulated_resource_consumption );
 								// is  cur_inner_splabel  dominated ?
 								if( dominanceResult > 0 ) {
-									typename std::list<Splabel>::iterator buf = inner_iter;
-									++inner_iter;
-									list_labels_cur_vertex.erase( buf );
+									inner_iter = ws.erase_label( list_labels_cur_vertex, inner_iter );
 
 
 									if( cur_inner_splabel->b_is_processed ) {
-										l_alloc.destroy( cur_inner_splabel.get() );
-										l_alloc.deallocate( cur_inner_splabel.get(), 1 );
+										ws.delete_label( cur_inner_splabel.get() );
 									
 									} else
 										cur_inner_splabel->b_is_dominated = true;
@@ -157,14 +245,11 @@ namespace boost {
 								// The other way around comparison:
 								// is  cur_outer_splabel  dominated ?
 								if( dominanceResult < 0 ) {
-									typename std::list<Splabel>::iterator buf = outer_iter;
-									++outer_iter;
-									list_labels_cur_vertex.erase( buf );
+									outer_iter = ws.erase_label( list_labels_cur_vertex, outer_iter );
 									b_outer_iter_erased = true;
 
 									if( cur_outer_splabel->b_is_processed ) {
-										l_alloc.destroy( cur_outer_splabel.get() );
-										l_alloc.deallocate( cur_outer_splabel.get(), 1 );
+										ws.delete_label( cur_outer_splabel.get() );
 
 									} else
 										cur_outer_splabel->b_is_dominated = true;
@@ -193,8 +278,7 @@ namespace boost {
 				
 				// When requested to find the 1st solution and just found it:
 				if( !b_all_pareto_optimal_solutions && cur_label->resident_vertex == t ) {
-					l_alloc.destroy( cur_label.get() );
-					l_alloc.deallocate( cur_label.get(), 1 );
+					ws.delete_label( cur_label.get() );
 
 					while( unprocessed_labels.size() ) {
 						Splabel l = unprocessed_labels.top();
@@ -203,8 +287,7 @@ namespace boost {
 						// delete only dominated labels, because nondominated labels are 
 						// deleted at the end of the function
 						if( l->b_is_dominated ) {
-							l_alloc.destroy( l.get() );
-							l_alloc.deallocate( l.get(), 1 );
+							ws.delete_label( l.get() );
 						}
 					}
 
@@ -221,8 +304,7 @@ namespace boost {
 					// expand from cur_vertex through all outgoing edges
 					for( boost::tie( oei, oei_end ) = out_edges( cur_vertex, g ); oei != oei_end; ++oei ) {
 						b_feasible = true;
-						r_c_shortest_paths_label<Graph, Resource_Container>* new_label = l_alloc.allocate( 1 );
-						l_alloc.construct( new_label, r_c_shortest_paths_label< Graph, Resource_Container >
+						r_c_shortest_paths_label<Graph, Resource_Container>* new_label = ws.new_label( r_c_shortest_paths_label< Graph, Resource_Container >
 															( (unsigned long)i_label_num++,  cur_label->cumulated_resource_consumption, 
 															cur_label.get(), *oei, target( *oei, g ) ) );
 						
@@ -232,15 +314,14 @@ namespace boost {
 						if( !b_feasible ) {
 							vis.on_label_not_feasible( *new_label, g );
 						
-							l_alloc.destroy( new_label );
-							l_alloc.deallocate( new_label, 1 );
+							ws.delete_label( new_label );
 						
 						} else { // b_feasible  is true
 							const r_c_shortest_paths_label<Graph, Resource_Container> &ref_new_label = *new_label;
 							vis.on_label_feasible( ref_new_label, g );
 							
 							Splabel new_sp_label( new_label );
-							vec_vertex_labels[size_t(vertex_index_map[size_t(new_sp_label->resident_vertex)])].push_back( new_sp_label );
+							ws.push_label( vec_vertex_labels[size_t(vertex_index_map[size_t(new_sp_label->resident_vertex)])], new_sp_label );
 							unprocessed_labels.push( new_sp_label );
 						}
 					}
@@ -248,12 +329,11 @@ namespace boost {
 				} else { // cur_label->b_is_dominated  is true
 					vis.on_label_dominated( *cur_label, g );
 
-					l_alloc.destroy( cur_label.get() );
-					l_alloc.deallocate( cur_label.get(), 1 );
+					ws.delete_label( cur_label.get() );
 				}
 			}
 			
-			std::list<Splabel> dsplabels = vec_vertex_labels[size_t(vertex_index_map[size_t(t)])];
+			const std::list<Splabel> &dsplabels = vec_vertex_labels[size_t(vertex_index_map[size_t(t)])];
 			typename std::list<Splabel>::const_iterator csi = dsplabels.begin();
 			typename std::list<Splabel>::const_iterator csi_end = dsplabels.end();
 			// if d could be reached from o
@@ -281,12 +361,41 @@ namespace boost {
 				csi_end = list_labels_cur_vertex.end();
 				
 				for( csi = list_labels_cur_vertex.begin(); csi != csi_end; ++csi ) {
-					l_alloc.destroy( (*csi).get() );
-					l_alloc.deallocate( (*csi).get(), 1 );
+					ws.delete_label( (*csi).get() );
 				}
 			}
 		} // r_c_shortest_paths_dispatch_adapted
 
+		// r_c_shortest_paths_dispatch_adapted overload using temporary buffers
+		template<class Graph, 
+		class VertexIndexMap, 
+		class EdgeIndexMap, 
+		class Resource_Container, 
+		class Resource_Extension_Function, 
+		class Dominance_Function, 
+		class Label_Allocator, 
+		class Visitor>
+			void r_c_shortest_paths_dispatch_adapted
+					( const Graph& g, 
+					const VertexIndexMap& vertex_index_map, 
+					const EdgeIndexMap& edge_index_map, 
+					typename graph_traits<Graph>::vertex_descriptor s, 
+					typename graph_traits<Graph>::vertex_descriptor t, 
+					std::vector< std::vector< typename graph_traits< Graph >::edge_descriptor> >& pareto_optimal_solutions, 
+					std::vector< Resource_Container >& pareto_optimal_resource_containers, 
+					bool b_all_pareto_optimal_solutions, 
+					const Resource_Container& rc, 
+					Resource_Extension_Function& ref, 
+					Dominance_Function& dominance, 
+					Label_Allocator /*la*/, 
+					Visitor vis )
+		{
+			r_c_shortest_paths_workspace< Graph, Resource_Container, Label_Allocator > ws;
+			r_c_shortest_paths_dispatch_adapted( g, vertex_index_map, edge_index_map, s, t,
+												pareto_optimal_solutions, pareto_optimal_resource_containers,
+												b_all_pareto_optimal_solutions, rc, ref, dominance, ws, vis );
+		}
+
 	} // detail
 
 } // namespace
@@ -1,4 +1,4 @@
-/******************************************************************
+﻿/******************************************************************
  Project TiltedMaze solves tilted maze problems.
 
  You might visit http://www.agame.com/game/tilt-maze
@@ -20,6 +20,13 @@
 *******************************************************************/
 
 #include "mazeSolver.h"
+#include "mazeBatch.h"
+#include "mazeImageParser.h"
+#include "mazeBinary.h"
+#include "mazeInput.h"
+#include "mazeArchive.h"
+#include "mazeStream.h"
+#include "mazeSequence.h"
 #include "environ.h"
 
 #pragma warning( push, 0 )
@@ -30,6 +37,8 @@
 
 #include <conio.h>
 #include <sstream>
+#include <io.h>
+#include <fcntl.h>
 
 #include <boost/filesystem/operations.hpp>
 
@@ -47,6 +56,205 @@ namespace {
 		if(ch==0||ch==0xE0) _getch(); // discard any chars left in the console buffer due to pressed function keys
 		os<<endl;
 	}
+
+	/**
+	Provides the walks (the ids of their branchless paths) of the solutions of maze, reusing workspace.
+	There are none when the maze can't be solved
+	*/
+	vector<vector<unsigned>> solutionWalks(const std::shared_ptr<const Maze> &maze, SolverWorkspace &workspace) {
+		vector<vector<unsigned>> walks;
+		MazeSolver ms(MazeQuery(make_shared<ProblemAdapter>(maze)));
+		if(ms.isSolvable(workspace)) {
+			for(const auto &rc : workspace.paretoOptRcs) {
+				walks.emplace_back();
+				for(const BranchlessPath *bp : rc.walk)
+					if(nullptr != bp)
+						walks.back().push_back(bp->id());
+			}
+		}
+		return walks;
+	}
+
+	/// Writes maze in the text format (see the .txt files from res)
+	void writeTextMaze(const Maze &maze, ostream &os) {
+		os<<maze.rowsCount()<<' '<<maze.columnsCount()<<endl;
+
+		const auto writeWalls = [&os] (const char *kind, const vector<boost::icl::split_interval_set<unsigned>> &rowsOrColumns,
+									   unsigned cellsCount) {
+			for(size_t idx = 0ULL; idx < rowsOrColumns.size(); ++idx) {
+				ostringstream walls;
+				for(const auto &limPair : rowsOrColumns[idx])
+					if(limPair.upper() > 0U && limPair.upper() < cellsCount)
+						walls<<' '<<limPair.upper() - 1U; // the index of the cell followed by the wall
+				if(false == walls.str().empty())
+					os<<kind<<' '<<idx<<':'<<walls.str()<<endl;
+			}
+		};
+		writeWalls("row", maze.rows(), maze.columnsCount());
+		writeWalls("column", maze.columns(), maze.rowsCount());
+
+		os<<maze.startLocation().row<<' '<<maze.startLocation().col<<endl;
+		for(const auto &target : maze.targets())
+			os<<target.row<<' '<<target.col<<endl;
+	}
+
+	/// Solves an image maze that couldn't be parsed with the default thresholds, trying concurrently the alternative ones
+	bool solveRobustly(const string &mazeName, bool consoleMode) {
+		MazeSolver solver(MazeQuery(make_shared<ProblemAdapter>(loadMazeRobustly(mazeName))));
+		return solver.solve(consoleMode);
+	}
+
+	/// Solves (in console mode) the mazes from a video, but only the frames where the maze changes
+	void solveSequence(const string &videoName) {
+		MazeSequence sequence(videoName);
+		bool changed = false;
+		for(;;) {
+			std::shared_ptr<const Maze> maze;
+			try {
+				maze = sequence.next(changed);
+			} catch(std::exception &e) {
+				cerr<<"Skipping frame "<<sequence.frameIndex()<<" : "<<e.what()<<endl;
+				continue;
+			}
+
+			if(nullptr == maze)
+				break;
+
+			if(changed) {
+				cout<<string(50, '=')<<endl<<maze->name()<<" :"<<endl<<endl;
+				MazeSolver solver(MazeQuery(make_shared<ProblemAdapter>(maze)));
+				if(false == solver.solve())
+					cout<<"Couldn't solve "<<maze->name()<<endl;
+			}
+		}
+		pressKeyToContinue(cout);
+	}
+
+	/// Solves one by one (in a single pass through the file) the mazes from a shard of an archive and reports the failures
+	void solveArchive(const string &archiveFile, unsigned shardIdx, unsigned shardsCount) {
+		const MazeArchive archive(archiveFile);
+		size_t first = 0ULL, last = 0ULL;
+		archive.shard(shardIdx, shardsCount, first, last);
+
+		MazeArchiveReader reader(archive, first, last);
+		SolverWorkspace workspace;
+		size_t solved = 0ULL;
+		for(;;) {
+			const size_t idx = reader.position();
+			std::shared_ptr<const Maze> maze;
+			try {
+				maze = reader.next();
+			} catch(std::exception &e) {
+				cerr<<"There were problems parsing "<<archive.mazeName(idx)<<" : "<<e.what()<<endl;
+				continue;
+			}
+			if(nullptr == maze)
+				break;
+
+			try {
+				MazeSolver ms(MazeQuery(make_shared<ProblemAdapter>(maze)));
+				if(ms.isSolvable(workspace))
+					++solved;
+				else
+					cerr<<"Maze "<<archive.mazeName(idx)<<" couldn't be solved!"<<endl;
+			} catch(std::exception &e) { // the maze was parsed above
+				cerr<<"There were problems solving "<<archive.mazeName(idx)<<" : "<<e.what()<<endl;
+			}
+		}
+		cout<<"Solved "<<solved<<" out of the "<<last - first<<" mazes from "<<archiveFile<<endl;
+	}
+
+	/// Solves all the mazes from an image containing several of them and reports the failures
+	void solveAllMazes(const string &imageFile) {
+		const vector<LoadedMaze> loadedMazes = loadAllMazes(imageFile);
+		SolverWorkspace workspace;
+		size_t solved = 0ULL;
+		for(const auto &loaded : loadedMazes) {
+			if(nullptr == loaded.maze) {
+				cerr<<"There were problems parsing "<<loaded.mazeFile<<" : "<<loaded.error<<endl;
+				continue;
+			}
+
+			try {
+				MazeSolver ms(MazeQuery(make_shared<ProblemAdapter>(loaded.maze)));
+				if(ms.isSolvable(workspace))
+					++solved;
+				else
+					cerr<<"Maze "<<loaded.mazeFile<<" couldn't be solved!"<<endl;
+			} catch(std::exception &e) { // the maze was parsed above
+				cerr<<"There were problems solving "<<loaded.mazeFile<<" : "<<e.what()<<endl;
+			}
+		}
+		cout<<"Solved "<<solved<<" out of the "<<loadedMazes.size()<<" mazes from "<<imageFile<<endl;
+	}
+
+	/// Solves the mazes from stdin as soon as each of them arrives (see MazeStreamReader for the format of the records)
+	void solveStdin() {
+		_setmode(_fileno(stdin), _O_BINARY); // the blobs must arrive unaltered
+
+		MazeStreamReader reader(cin, "stdin");
+		SolverWorkspace workspace;
+		for(;;) {
+			std::shared_ptr<const Maze> maze;
+			try {
+				maze = reader.next();
+			} catch(std::exception &e) {
+				cerr<<"There were problems parsing record "<<reader.recordsRead()<<" from stdin : "<<e.what()<<endl;
+				if(cin.eof())
+					break;
+				continue;
+			}
+			if(nullptr == maze)
+				break;
+
+			try {
+				MazeSolver ms(MazeQuery(make_shared<ProblemAdapter>(maze)));
+				cout<<maze->name()<<(ms.isSolvable(workspace) ? " can be solved" : " couldn't be solved!")<<endl; // endl reports each maze right away
+			} catch(std::exception &e) { // the maze was parsed above
+				cerr<<"There were problems solving "<<maze->name()<<" : "<<e.what()<<endl;
+			}
+		}
+	}
+
+	/**
+	Handles the command line options, returning false when there are none:
+	--convert <text or image maze> <binary maze (.tmz)>
+	--archive <archive (.tma)> <maze files ...>
+	--solve-archive <archive (.tma)> [<shard index> <shards count>]
+	--all-mazes <image with several mazes>
+	--stdin (solves the mazes streamed through the standard input)
+	*/
+	bool runCommand(int argc, char *argv[]) {
+		if(argc < 2)
+			return false;
+
+		const string command(argv[1]);
+		try {
+			if(argc == 4 && command.compare("--convert") == 0) {
+				convertToBinaryMaze(argv[2], argv[3]);
+				cout<<"Converted "<<argv[2]<<" into "<<argv[3]<<endl;
+
+			} else if(argc >= 4 && command.compare("--archive") == 0) {
+				buildMazeArchive(vector<string>(argv + 3, argv + argc), argv[2]);
+				cout<<"Archived "<<argc - 3<<" mazes into "<<argv[2]<<endl;
+
+			} else if((argc == 3 || argc == 5) && command.compare("--solve-archive") == 0) {
+				solveArchive(argv[2], (argc == 5) ? (unsigned)stoul(argv[3]) : 0U, (argc == 5) ? (unsigned)stoul(argv[4]) : 1U);
+
+			} else if(argc == 3 && command.compare("--all-mazes") == 0) {
+				solveAllMazes(argv[2]);
+
+			} else if(argc == 2 && command.compare("--stdin") == 0) {
+				solveStdin();
+
+			} else
+				return false;
+
+		} catch(std::exception &e) {
+			cerr<<"Couldn't perform "<<command<<" : "<<e.what()<<endl;
+		}
+		return true;
+	}
 }
 
 /// Verifying all existing test files
@@ -61,33 +269,143 @@ static bool testsOk() {
 	const vector<const string> knownExtensions { ".bmp", ".jpg", ".jpeg", ".png", ".tif", ".tiff", ".txt" };
 
 	path mazePrefix, mazePathNoExt, mazePath;
+	vector<string> mazeFiles, textFiles; // textFiles[i] is the text version of mazeFiles[i]
 
 	for(const auto &prefix : knownPrefixes) {
 		mazePrefix = path(resFolder).append(prefix);
 		for(const auto &suffix : knownSuffixes) {
 			mazePathNoExt = path(mazePrefix).concat(suffix);
+			const string textFile = path(resFolder).append("maze" + suffix + ".txt").string();
 			for(const auto &extension : knownExtensions) {
 				mazePath = path(mazePathNoExt).concat(extension);
 				if(exists(mazePath)) {
-					try {
-						MazeSolver ms(mazePath.string());
-						if(!ms.isSolvable()) {
-							cerr<<"Maze "<<mazePath<<" couldn't be solved!"<<endl;
-							ok = false;
-						}
-					} catch(std::exception &e) {
-						cerr<<"There were problems parsing "<<mazePath<<" : "<<endl<<'\t'<<e.what()<<endl<<endl;
-						ok = false;
-					}
+					mazeFiles.push_back(mazePath.string());
+					textFiles.push_back(textFile);
+				}
+			}
+		}
+	}
+
+	// Parsing all mazes in parallel, then solving them one by one
+	SolverWorkspace workspace;
+	const vector<LoadedMaze> loadedMazes = loadMazes(mazeFiles);
+	for(size_t mazeIdx = 0ULL; mazeIdx < loadedMazes.size(); ++mazeIdx) {
+		const LoadedMaze &loaded = loadedMazes[mazeIdx];
+		if(nullptr == loaded.maze) {
+			cerr<<"There were problems parsing "<<path(loaded.mazeFile)<<" : "<<endl<<'\t'<<loaded.error<<endl<<endl;
+			ok = false;
+			continue;
+		}
+
+		vector<vector<unsigned>> walks;
+		try {
+			walks = solutionWalks(loaded.maze, workspace);
+			if(walks.empty()) {
+				cerr<<"Maze "<<path(loaded.mazeFile)<<" couldn't be solved!"<<endl;
+				ok = false;
+			}
+		} catch(std::exception &e) { // the maze was parsed above
+			cerr<<"There were problems solving "<<path(loaded.mazeFile)<<" : "<<endl<<'\t'<<e.what()<<endl<<endl;
+			ok = false;
+			continue;
+		}
+
+		// The image mazes get parsed from sparse samples by default. They must match their text version and the dense parse
+		if(path(loaded.mazeFile).extension() != ".txt") {
+			try {
+				ImageParsingBuffers denseBuffers;
+				denseBuffers.denseSampling = true;
+				if(false == loaded.maze->sameContent(Maze(textFiles[mazeIdx]))) {
+					cerr<<"Maze "<<path(loaded.mazeFile)<<" differs from "<<path(textFiles[mazeIdx])<<endl;
+					ok = false;
+				}
+				if(false == loaded.maze->sameContent(Maze(loaded.mazeFile, denseBuffers))) {
+					cerr<<"The sparse and the dense parses of "<<path(loaded.mazeFile)<<" differ!"<<endl;
+					ok = false;
+				}
+			} catch(std::exception &e) {
+				cerr<<"There were problems comparing "<<path(loaded.mazeFile)<<" with its other versions : "<<endl<<'\t'<<e.what()<<endl<<endl;
+				ok = false;
+			}
+		}
+
+		// The maze and its solutions must survive unchanged the round-trips through the binary format and the stream records
+		const vector<const string> roundTrips { "the binary format", "a text record", "a blob record" };
+		try {
+			ostringstream binaryOss;
+			saveBinaryMaze(*loaded.maze, binaryOss);
+			const string binary = binaryOss.str();
+
+			ostringstream recordsOss;
+			writeTextMaze(*loaded.maze, recordsOss);
+			recordsOss<<"---"<<endl<<"blob "<<binary.size()<<endl<<binary;
+			istringstream recordsIss(recordsOss.str());
+			MazeStreamReader reader(recordsIss, loaded.mazeFile);
+
+			vector<std::shared_ptr<const Maze>> copies; // in the order of roundTrips
+			copies.push_back(make_shared<Maze>(ByteSpan(binary.data(), binary.size()), loaded.mazeFile));
+			copies.push_back(reader.next());
+			copies.push_back(reader.next());
+			for(size_t idx = 0ULL; idx < copies.size(); ++idx) {
+				if(nullptr == copies[idx] || false == copies[idx]->sameContent(*loaded.maze) ||
+						solutionWalks(copies[idx], workspace) != walks) {
+					cerr<<"Maze "<<path(loaded.mazeFile)<<" changed after a round-trip through "<<roundTrips[idx]<<endl;
+					ok = false;
 				}
 			}
+		} catch(std::exception &e) {
+			cerr<<"There were problems during the round-trips of "<<path(loaded.mazeFile)<<" : "<<endl<<'\t'<<e.what()<<endl<<endl;
+			ok = false;
 		}
 	}
 
+	// Parsing several mazes from a single image, which places some of the test images on a white background
+	const vector<const string> composedMazes { "maze1.bmp", "maze2.png", "maze4.png", "maze8.png" };
+	enum { COMPOSED_PER_ROW = 2, COMPOSED_GAP = 40 };
+	vector<cv::Mat> composedImgs;
+	int composedCellWidth = 0, composedCellHeight = 0;
+	for(const auto &composedMaze : composedMazes) {
+		composedImgs.push_back(cv::imread(path(resFolder).append(composedMaze).string()));
+		composedCellWidth = max(composedCellWidth, composedImgs.back().cols);
+		composedCellHeight = max(composedCellHeight, composedImgs.back().rows);
+	}
+	const int composedRows = ((int)composedMazes.size() + COMPOSED_PER_ROW - 1) / COMPOSED_PER_ROW;
+	cv::Mat composedImg(COMPOSED_GAP + composedRows * (composedCellHeight + COMPOSED_GAP),
+						COMPOSED_GAP + COMPOSED_PER_ROW * (composedCellWidth + COMPOSED_GAP), CV_8UC3, cv::Scalar::all(255.));
+	for(int idx = 0, lim = (int)composedImgs.size(); idx < lim; ++idx) {
+		const cv::Mat &img = composedImgs[(size_t)idx];
+		img.copyTo(composedImg(cv::Rect(COMPOSED_GAP + (idx % COMPOSED_PER_ROW) * (composedCellWidth + COMPOSED_GAP),
+										COMPOSED_GAP + (idx / COMPOSED_PER_ROW) * (composedCellHeight + COMPOSED_GAP),
+										img.cols, img.rows)));
+	}
+
+	try {
+		const vector<LoadedMaze> composedResults = loadAllMazes(composedImg, "the composed image");
+		if(composedResults.size() != composedMazes.size()) {
+			cerr<<"Found "<<composedResults.size()<<" mazes instead of "<<composedMazes.size()<<" within the composed image!"<<endl;
+			ok = false;
+		} else for(size_t idx = 0ULL; idx < composedResults.size(); ++idx) {
+			const LoadedMaze &loaded = composedResults[idx];
+			if(nullptr == loaded.maze) {
+				cerr<<"There were problems parsing "<<loaded.mazeFile<<" : "<<endl<<'\t'<<loaded.error<<endl<<endl;
+				ok = false;
+			} else if(false == loaded.maze->sameContent(Maze(path(resFolder).append(path(composedMazes[idx]).stem().string() + ".txt").string()))) {
+				cerr<<loaded.mazeFile<<" differs from "<<composedMazes[idx]<<endl;
+				ok = false;
+			}
+		}
+	} catch(std::exception &e) {
+		cerr<<"There were problems parsing the composed image : "<<endl<<'\t'<<e.what()<<endl<<endl;
+		ok = false;
+	}
+
 	return ok;
 }
 
-void main(int, char *[]) {
+void main(int argc, char *argv[]) {
+	if(runCommand(argc, argv))
+		return;
+
 	if(testsOk())
 		cout<<"All tests were ok."<<endl<<"Entering interactive demonstration mode ..."<<endl;
 	else {
@@ -107,9 +425,11 @@ void main(int, char *[]) {
 	// use the contents of szFile to initialize itself.
 	ofn.lpstrFile[0] = '\0';
 	ofn.nMaxFile = sizeof(szFile);
-	ofn.lpstrFilter = _T("All Input Maze Types\0*.txt;*.bmp;*.png;*.tif;*.tiff;*.jpg;*.jpeg\0")
+	ofn.lpstrFilter = _T("All Input Maze Types\0*.txt;*.tmz;*.bmp;*.png;*.tif;*.tiff;*.jpg;*.jpeg;*.avi;*.mp4;*.mpg;*.mpeg;*.wmv\0")
 						 _T("Text Input Mazes\0*.txt\0")
-						 _T("Image Input Mazes\0*.bmp;*.png;*.tif;*.tiff;*.jpg;*.jpeg\0");
+						 _T("Binary Input Mazes\0*.tmz\0")
+						 _T("Image Input Mazes\0*.bmp;*.png;*.tif;*.tiff;*.jpg;*.jpeg\0")
+						 _T("Video Input Mazes\0*.avi;*.mp4;*.mpg;*.mpeg;*.wmv\0");
 	ofn.nFilterIndex = 1;
 	ofn.lpstrFileTitle = nullptr;
 	ofn.nMaxFileTitle = 0;
@@ -121,12 +441,34 @@ void main(int, char *[]) {
 
 	while(GetOpenFileName(&ofn)) {
 		string mazeName = tstrToStr(ofn.lpstrFile);
+		const string ext = path(mazeName).extension().string();
+		if(false == ext.empty() && string::npos != string(".avi.mp4.mpg.mpeg.wmv").find(ext)) {
+			try {
+				solveSequence(mazeName);
+			} catch(std::exception &e) {
+				cerr<<"Error detected in '"<<mazeName<<"': "<<e.what()<<endl;
+				pressKeyToContinue(cerr);
+			}
+			continue;
+		}
+
 		if(consoleMode)
 			cout<<string(50, '=')<<endl<<"Maze "<<mazeName<<" :"<<endl<<endl;
 
 		try {
-			MazeSolver maze(mazeName/*, true*/);
-			if(false == maze.solve(consoleMode/*, true*/)) {
+			bool solved = false;
+			try {
+				MazeSolver maze(mazeName/*, true*/);
+				solved = maze.solve(consoleMode/*, true*/);
+			} catch(domain_error &e) {
+				if(ext.compare(".txt") == 0 || ext.compare(".tmz") == 0)
+					throw; // only images might need other thresholds
+
+				cerr<<"Retrying '"<<mazeName<<"' with alternative thresholds, after: "<<e.what()<<endl;
+				solved = solveRobustly(mazeName, consoleMode);
+			}
+
+			if(false == solved) {
 				cout<<"Couldn't solve "<<mazeName<<endl;
 				pressKeyToContinue(cout);
 			}
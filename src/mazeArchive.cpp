@@ -0,0 +1,201 @@
+/******************************************************************
+ Project TiltedMaze solves tilted maze problems.
+
+ You might visit http://www.agame.com/game/tilt-maze
+ to try yourself solving such problems (use the arrow keys to move)
+
+ The program is able to load the puzzle from text files, but also
+ from captured snapshots, which contain various imperfections.
+ It is possible to recognize the original maze even when rotating,
+ mirroring the snapshot, or even after applying perspective
+ transformations on it.
+ 
+ Solving the maze is presented as an animation, either on console,
+ or within a normal window.
+
+ The project uses OpenCV and Boost.
+
+ Copyright (c) 2014, 2017 Florin Tulba
+
+*******************************************************************/
+
+#include "mazeArchive.h"
+#include "mazeBinary.h"
+#include "mazeBatch.h"
+
+#pragma warning( push, 0 )
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include <boost/filesystem/operations.hpp>
+
+#pragma warning( pop )
+
+using namespace std;
+
+namespace {
+	const char mazeArchiveSignature[] = { 'T', 'M', 'Z', 'A' };
+
+	enum { ARCHIVED_MAZES_PER_CHUNK = 1024 }; ///< mazes parsed together while building an archive
+
+	/// 64-bit FNV-1a hash
+	UINT64 contentHash(const ByteSpan &content) {
+		UINT64 hash = 14695981039346656037ULL;
+		for(const char *it = content.data, *itEnd = content.data + content.size; it != itEnd; ++it) {
+			hash ^= (UINT8)*it;
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+}
+
+MazeArchive::MazeArchive(const string &archiveFile) : file(archiveFile), index(), names(nullptr) {
+	const ByteSpan bytes = file.bytes();
+	if(bytes.size < sizeof(MazeArchiveFooter))
+		throw invalid_argument(archiveFile + " isn't a maze archive!");
+
+	MazeArchiveFooter footer;
+	memcpy(&footer, bytes.data + bytes.size - sizeof footer, sizeof footer);
+	if(0 != memcmp(footer.signature, mazeArchiveSignature, sizeof(mazeArchiveSignature)))
+		throw invalid_argument(archiveFile + " isn't a maze archive!");
+	if(footer.version != MazeArchiveFooter::CURRENT_VERSION)
+		throw invalid_argument("Unsupported version of the maze archive " + archiveFile);
+
+	const UINT64 indexBytes = (UINT64)footer.entriesCount * sizeof(MazeArchiveEntry),
+		namesOffset = footer.indexOffset + indexBytes;
+	if(footer.indexOffset > bytes.size || namesOffset > bytes.size - sizeof footer)
+		throw invalid_argument("The index of the maze archive " + archiveFile + " is corrupt!");
+
+	index.resize((size_t)footer.entriesCount);
+	memcpy(index.data(), bytes.data + footer.indexOffset, (size_t)indexBytes);
+	names = bytes.data + namesOffset;
+
+	const UINT64 namesBytes = bytes.size - sizeof footer - namesOffset;
+	for(const auto &entry : index)
+		if(entry.offset > footer.indexOffset || entry.size > footer.indexOffset - entry.offset ||
+				(UINT64)entry.nameOffset + entry.nameLength > namesBytes)
+			throw invalid_argument("The index of the maze archive " + archiveFile + " is corrupt!");
+}
+
+const MazeArchiveEntry& MazeArchive::entry(size_t idx) const {
+	if(idx >= index.size())
+		throw out_of_range("There's no maze with such an index within the archive!");
+
+	return index[idx];
+}
+
+string MazeArchive::mazeName(size_t idx) const {
+	const MazeArchiveEntry &e = entry(idx);
+	return string(names + e.nameOffset, (size_t)e.nameLength);
+}
+
+ByteSpan MazeArchive::content(size_t idx) const {
+	const MazeArchiveEntry &e = entry(idx);
+	return ByteSpan(file.bytes().data + e.offset, (size_t)e.size);
+}
+
+bool MazeArchive::intact(size_t idx) const {
+	return contentHash(content(idx)) == entry(idx).hash;
+}
+
+shared_ptr<const Maze> MazeArchive::maze(size_t idx, bool verbose/* = false*/) const {
+	if(false == intact(idx))
+		throw domain_error("The content of " + mazeName(idx) + " from the maze archive " + name() + " is corrupt!");
+
+	return make_shared<Maze>(content(idx), mazeName(idx), verbose);
+}
+
+void MazeArchive::shard(unsigned shardIdx, unsigned shardsCount, size_t &first, size_t &last) const {
+	if(shardIdx >= shardsCount)
+		throw invalid_argument("The index of the shard must be less than the count of shards!");
+
+	// the first (size % shardsCount) shards get an extra maze
+	const size_t shardSize = index.size() / shardsCount, extraMazes = index.size() % shardsCount;
+	first = shardIdx * shardSize + min((size_t)shardIdx, extraMazes);
+	last = first + shardSize + ((size_t)shardIdx < extraMazes ? 1ULL : 0ULL);
+}
+
+MazeArchiveReader::MazeArchiveReader(const MazeArchive &archive, size_t first/* = 0ULL*/, size_t last/* = SIZE_MAX*/) :
+		archive(archive), nextIdx(min(first, archive.size())), lastIdx(min(last, archive.size())) {}
+
+shared_ptr<const Maze> MazeArchiveReader::next(bool verbose/* = false*/) {
+	if(nextIdx >= lastIdx)
+		return nullptr;
+
+	return archive.maze(nextIdx++, verbose); // advances even when the maze can't be parsed
+}
+
+void buildMazeArchive(const vector<string> &mazeFiles, const string &archiveFile,
+					  unsigned workerThreads/* = 0U*/, bool verbose/* = false*/) {
+	const string partialFile = archiveFile + ".part"; // gets the final name only when complete
+	ofstream ofs(partialFile, ios::binary);
+	if(!ofs)
+		throw runtime_error("Couldn't create the maze archive " + archiveFile);
+
+	vector<MazeArchiveEntry> index;
+	index.reserve(mazeFiles.size());
+	string names;
+	UINT64 offset = 0ULL;
+
+	boost::system::error_code ignoredError;
+	try {
+		// Parsing the mazes in parallel, a chunk at a time, to keep only a few of them in memory
+		for(auto itChunk = mazeFiles.cbegin(); itChunk != mazeFiles.cend();) {
+			const auto itChunkEnd = itChunk + min((ptrdiff_t)ARCHIVED_MAZES_PER_CHUNK, mazeFiles.cend() - itChunk);
+			for(const auto &loaded : loadMazes(vector<string>(itChunk, itChunkEnd), workerThreads, verbose)) {
+				if(nullptr == loaded.maze)
+					throw domain_error("Couldn't archive " + loaded.mazeFile + " : " + loaded.error);
+
+				ostringstream oss;
+				saveBinaryMaze(*loaded.maze, oss);
+				const string content = oss.str();
+				ofs.write(content.data(), (streamsize)content.size());
+
+				MazeArchiveEntry entry;
+				entry.offset = offset;
+				entry.size = content.size();
+				entry.hash = contentHash(ByteSpan(content.data(), content.size()));
+				entry.rowsCount = loaded.maze->rowsCount();
+				entry.columnsCount = loaded.maze->columnsCount();
+				entry.nameOffset = (UINT32)names.size();
+				entry.nameLength = (UINT32)loaded.mazeFile.size();
+				index.push_back(entry);
+
+				names += loaded.mazeFile;
+				offset += content.size();
+			}
+			itChunk = itChunkEnd;
+		}
+
+		MazeArchiveFooter footer;
+		memset(&footer, 0, sizeof footer);
+		footer.indexOffset = offset;
+		footer.entriesCount = (UINT32)index.size();
+		footer.version = (UINT16)MazeArchiveFooter::CURRENT_VERSION;
+		memcpy(footer.signature, mazeArchiveSignature, sizeof(mazeArchiveSignature));
+
+		ofs.write(reinterpret_cast<const char*>(index.data()), (streamsize)(index.size() * sizeof(MazeArchiveEntry)));
+		ofs.write(names.data(), (streamsize)names.size());
+		ofs.write(reinterpret_cast<const char*>(&footer), sizeof footer);
+		ofs.close();
+		if(ofs.fail())
+			throw runtime_error("Couldn't write the maze archive " + archiveFile);
+	} catch(...) {
+		ofs.close();
+		boost::filesystem::remove(partialFile, ignoredError);
+		throw;
+	}
+
+	boost::system::error_code renameError;
+	boost::filesystem::rename(partialFile, archiveFile, renameError); // replaces any previous archiveFile
+	if(renameError) {
+		boost::filesystem::remove(partialFile, ignoredError);
+		throw runtime_error("Couldn't write the maze archive " + archiveFile + " : " + renameError.message());
+	}
+
+	if(verbose)
+		cout<<"Archived "<<index.size()<<" mazes into "<<archiveFile<<endl;
+}
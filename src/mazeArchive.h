@@ -0,0 +1,131 @@
+/******************************************************************
+ Project TiltedMaze solves tilted maze problems.
+
+ You might visit http://www.agame.com/game/tilt-maze
+ to try yourself solving such problems (use the arrow keys to move)
+
+ The program is able to load the puzzle from text files, but also
+ from captured snapshots, which contain various imperfections.
+ It is possible to recognize the original maze even when rotating,
+ mirroring the snapshot, or even after applying perspective
+ transformations on it.
+ 
+ Solving the maze is presented as an animation, either on console,
+ or within a normal window.
+
+ The project uses OpenCV and Boost.
+
+ Copyright (c) 2014, 2017 Florin Tulba
+
+*******************************************************************/
+
+#ifndef H_MAZE_ARCHIVE
+#define H_MAZE_ARCHIVE
+
+#include "mazeStruct.h"
+#include "mazeInput.h"
+
+#pragma warning( push, 0 )
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#pragma warning( pop )
+
+#pragma pack( push, 1 )
+
+/// Index entry of a maze from an archive
+struct MazeArchiveEntry {
+	UINT64 offset, size;	///< the location of the content of the maze within the archive
+	UINT64 hash;			///< FNV-1a hash of the content
+	UINT32 rowsCount, columnsCount;
+	UINT32 nameOffset, nameLength; ///< the original name of the maze, within the names following the index
+};
+
+/**
+Last bytes of a maze archive (.tma file). The archive contains:
+- the contents of the mazes (in the binary format, one after the other)
+- the index: entriesCount MazeArchiveEntry-s, starting at indexOffset
+- the names of the mazes (not null-terminated)
+- this footer
+All numbers are little-endian.
+*/
+struct MazeArchiveFooter {
+	enum { CURRENT_VERSION = 1 };
+
+	UINT64 indexOffset;
+	UINT32 entriesCount;
+	UINT32 reserved;		///< 0 for now
+	UINT16 version;			///< the version of the format
+	UINT16 reserved2;		///< 0 for now
+	char signature[4];		///< "TMZA"
+};
+
+#pragma pack( pop )
+
+/**
+Random access to the mazes from a memory-mapped archive.
+It's safe to read the same archive from several threads.
+*/
+class MazeArchive {
+	MappedFile file;
+	std::vector<MazeArchiveEntry> index;
+	const char *names;	///< the names following the index within the mapped file
+
+public:
+	/// Throws invalid_argument when the file isn't a valid archive
+	MazeArchive(const std::string &archiveFile);
+
+	MazeArchive(const MazeArchive&) = delete;
+	void operator=(const MazeArchive&) = delete;
+
+	inline const std::string& name() const { return file.name(); }
+	inline size_t size() const { return index.size(); }
+
+	/// Index entry of the maze idx. Throws out_of_range for invalid indices
+	const MazeArchiveEntry& entry(size_t idx) const;
+
+	std::string mazeName(size_t idx) const;	///< original name of the maze idx
+	ByteSpan content(size_t idx) const;		///< content of the maze idx, without copying it
+	bool intact(size_t idx) const;			///< checks the content of the maze idx against its hash
+
+	/// Parses the maze idx. Throws domain_error when its content doesn't match its hash
+	std::shared_ptr<const Maze> maze(size_t idx, bool verbose = false) const;
+
+	/**
+	Splits the archive in shardsCount contiguous parts of balanced sizes and provides the range [first, last) of shardIdx.
+	Throws invalid_argument when shardIdx isn't less than shardsCount.
+	*/
+	void shard(unsigned shardIdx, unsigned shardsCount, size_t &first, size_t &last) const;
+};
+
+/// Parses in order the mazes from a range of an archive (like a shard), one at a time
+class MazeArchiveReader {
+	const MazeArchive &archive;
+	size_t nextIdx, lastIdx;
+
+public:
+	/// The range is limited to the size of the archive
+	MazeArchiveReader(const MazeArchive &archive, size_t first = 0ULL, size_t last = SIZE_MAX);
+
+	/// Index of the maze returned by the next call to next()
+	inline size_t position() const { return nextIdx; }
+
+	/**
+	Parses the next maze or returns nullptr at the end of the range.
+	Parsing errors (including corrupt contents) are thrown, but they don't stop the reader
+	*/
+	std::shared_ptr<const Maze> next(bool verbose = false);
+};
+
+/**
+Parses the mazeFiles (text or images) using a pool of workerThreads threads (0 means one per hardware thread)
+and stores them in the binary format within a new archive.
+The archive is written under a temporary name and gets its final name only when complete, so failures leave no partial archive.
+Throws domain_error when some maze can't be parsed and runtime_error when the archive can't be written.
+*/
+void buildMazeArchive(const std::vector<std::string> &mazeFiles, const std::string &archiveFile,
+					  unsigned workerThreads = 0U, bool verbose = false);
+
+#endif // H_MAZE_ARCHIVE
\ No newline at end of file
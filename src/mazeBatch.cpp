@@ -0,0 +1,192 @@
+/******************************************************************
+ Project TiltedMaze solves tilted maze problems.
+
+ You might visit http://www.agame.com/game/tilt-maze
+ to try yourself solving such problems (use the arrow keys to move)
+
+ The program is able to load the puzzle from text files, but also
+ from captured snapshots, which contain various imperfections.
+ It is possible to recognize the original maze even when rotating,
+ mirroring the snapshot, or even after applying perspective
+ transformations on it.
+ 
+ Solving the maze is presented as an animation, either on console,
+ or within a normal window.
+
+ The project uses OpenCV and Boost.
+
+ Copyright (c) 2014, 2017 Florin Tulba
+
+*******************************************************************/
+
+#include "mazeBatch.h"
+#include "mazeImageParser.h"
+#include "mazeInput.h"
+
+#pragma warning( push, 0 )
+
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <sstream>
+
+#pragma warning( pop )
+
+using namespace std;
+
+namespace {
+	/**
+	Joins the threads still running when leaving the scope, including due to an exception
+	(like failing to start a later thread), as destroying a joinable thread terminates the program.
+	*/
+	class ThreadsJoiner {
+		vector<thread> &threads;
+
+	public:
+		ThreadsJoiner(vector<thread> &threads) : threads(threads) {}
+		~ThreadsJoiner() {
+			for(auto &t : threads)
+				if(t.joinable())
+					t.join();
+		}
+
+		ThreadsJoiner(const ThreadsJoiner&) = delete;
+		void operator=(const ThreadsJoiner&) = delete;
+	};
+
+	/**
+	Runs task(idx, buffers) for each idx from [0, tasksCount) using a pool of workerThreads threads (0 means one per hardware thread).
+	Each worker keeps its own image parsing buffers between the tasks it handles.
+	*/
+	void runOnWorkers(size_t tasksCount, unsigned workerThreads,
+					  const function<void(size_t, ImageParsingBuffers&)> &task) {
+		if(tasksCount == 0ULL)
+			return;
+
+		if(workerThreads == 0U)
+			workerThreads = max(1U, thread::hardware_concurrency());
+		workerThreads = (unsigned)min((size_t)workerThreads, tasksCount);
+
+		atomic<size_t> nextIdx(0ULL); // the workers pick the tasks in the order they become available
+		const auto worker = [&] {
+			ImageParsingBuffers buffers; // reused for all the tasks handled by this worker
+			for(size_t idx = nextIdx++; idx < tasksCount; idx = nextIdx++)
+				task(idx, buffers);
+		};
+
+		vector<thread> helpers;
+		const ThreadsJoiner joiner(helpers);
+		helpers.reserve((size_t)workerThreads - 1ULL);
+		for(unsigned i = 1U; i < workerThreads; ++i)
+			helpers.emplace_back(worker);
+		worker(); // the calling thread is a worker, too
+		for(auto &helper : helpers)
+			helper.join();
+	}
+}
+
+vector<LoadedMaze> loadMazes(const vector<string> &mazeFiles,
+							 unsigned workerThreads/* = 0U*/, bool verbose/* = false*/) {
+	vector<LoadedMaze> results(mazeFiles.size());
+	runOnWorkers(mazeFiles.size(), workerThreads, [&] (size_t idx, ImageParsingBuffers &buffers) {
+		LoadedMaze &result = results[idx];
+		result.mazeFile = mazeFiles[idx];
+		try {
+			result.maze = make_shared<Maze>(result.mazeFile, buffers, verbose);
+		} catch(std::exception &e) {
+			result.error = e.what();
+		}
+	});
+
+	return results;
+}
+
+vector<LoadedMaze> loadAllMazes(const string &imageFile,
+								unsigned workerThreads/* = 0U*/, bool verbose/* = false*/) {
+	cv::Mat img;
+	{
+		MappedFile mappedFile(imageFile);
+		img = ImageMazeParser::decode(mappedFile.bytes());
+	}
+	if(img.empty())
+		throw invalid_argument("The provided file isn't a valid image!");
+
+	return loadAllMazes(img, imageFile, workerThreads, verbose);
+}
+
+vector<LoadedMaze> loadAllMazes(const cv::Mat &bgrImg, const string &imageName,
+								unsigned workerThreads/* = 0U*/, bool verbose/* = false*/) {
+	if(bgrImg.type() != CV_8UC3)
+		throw invalid_argument("The image isn't a standard RGB image!");
+
+	ImageParsingBuffers locatingBuffers;
+	const vector<MazeLocation> locations = ImageMazeParser::locateMazes(bgrImg, locatingBuffers);
+	if(locations.empty())
+		throw domain_error("Couldn't find any maze within " + imageName + " !");
+
+	if(verbose)
+		cout<<"Found "<<locations.size()<<" mazes within "<<imageName<<endl;
+
+	vector<LoadedMaze> results(locations.size());
+	runOnWorkers(locations.size(), workerThreads, [&] (size_t idx, ImageParsingBuffers &buffers) {
+		LoadedMaze &result = results[idx];
+		ostringstream oss;
+		oss<<imageName<<" [maze "<<idx + 1ULL<<']';
+		result.mazeFile = oss.str();
+		try {
+			result.maze = make_shared<Maze>(bgrImg, locations[idx], result.mazeFile, buffers, verbose);
+		} catch(std::exception &e) {
+			result.error = e.what();
+		}
+	});
+
+	return results;
+}
+
+shared_ptr<const Maze> loadMazeRobustly(const string &mazeFile, bool verbose/* = false*/) {
+	cv::Mat img;
+	{
+		MappedFile mappedFile(mazeFile);
+		img = ImageMazeParser::decode(mappedFile.bytes());
+	}
+	if(img.empty())
+		throw invalid_argument("The provided file isn't a valid image!");
+
+	const vector<ParsingThresholds> &portfolio = ImageMazeParser::thresholdsPortfolio;
+	const size_t attempts = portfolio.size();
+	vector<shared_ptr<const Maze>> mazes(attempts);
+	vector<string> errors(attempts);
+	atomic<size_t> firstSuccess(attempts); // the index of the first consistent parse, in the portfolio order
+
+	const auto attempt = [&] (size_t idx) {
+		ImageParsingBuffers buffers;
+		buffers.thresholds = portfolio[idx];
+		buffers.strict = true;
+		buffers.abandoned = [&firstSuccess, idx] { return firstSuccess.load() < idx; };
+		try {
+			mazes[idx] = make_shared<Maze>(img, mazeFile, buffers, verbose && idx == 0ULL); // the reports of the other attempts would interleave
+			for(size_t prevSuccess = firstSuccess.load();
+				idx < prevSuccess && false == firstSuccess.compare_exchange_weak(prevSuccess, idx););
+		} catch(std::exception &e) {
+			errors[idx] = e.what();
+		}
+	};
+
+	vector<thread> helpers;
+	const ThreadsJoiner joiner(helpers);
+	helpers.reserve(attempts - 1ULL);
+	for(size_t idx = 1ULL; idx < attempts; ++idx)
+		helpers.emplace_back(attempt, idx);
+	attempt(0ULL); // the calling thread uses the default thresholds
+	for(auto &helper : helpers)
+		helper.join();
+
+	if(firstSuccess.load() == attempts)
+		throw domain_error("None of the thresholds sets could parse " + mazeFile + " . With the default ones: " + errors[0]);
+
+	if(verbose && firstSuccess.load() > 0ULL)
+		cout<<"The maze "<<mazeFile<<" was parsed using the alternative thresholds set "<<firstSuccess.load()<<endl;
+
+	return mazes[firstSuccess.load()];
+}
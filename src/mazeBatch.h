@@ -0,0 +1,72 @@
+/******************************************************************
+ Project TiltedMaze solves tilted maze problems.
+
+ You might visit http://www.agame.com/game/tilt-maze
+ to try yourself solving such problems (use the arrow keys to move)
+
+ The program is able to load the puzzle from text files, but also
+ from captured snapshots, which contain various imperfections.
+ It is possible to recognize the original maze even when rotating,
+ mirroring the snapshot, or even after applying perspective
+ transformations on it.
+ 
+ Solving the maze is presented as an animation, either on console,
+ or within a normal window.
+
+ The project uses OpenCV and Boost.
+
+ Copyright (c) 2014, 2017 Florin Tulba
+
+*******************************************************************/
+
+#ifndef H_MAZE_BATCH
+#define H_MAZE_BATCH
+
+#include "mazeStruct.h"
+
+#pragma warning( push, 0 )
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#pragma warning( pop )
+
+/// Outcome of loading one of the mazes from a batch
+struct LoadedMaze {
+	std::string mazeFile;				///< the source of the maze
+	std::shared_ptr<const Maze> maze;	///< the parsed maze or nullptr when parsing failed
+	std::string error;					///< the reason of the failure, if any
+};
+
+/**
+Parses the mazeFiles using a pool of workerThreads threads (0 means one per hardware thread).
+Each worker keeps its own image parsing buffers between the images it handles.
+The results preserve the order of mazeFiles. Parsing errors don't stop the batch; they're reported in the results.
+*/
+std::vector<LoadedMaze> loadMazes(const std::vector<std::string> &mazeFiles,
+								  unsigned workerThreads = 0U, bool verbose = false);
+
+/**
+Parses all the mazes from an image (like a screenshot with several levels), decoding and classifying it only once.
+The mazes are located by ImageMazeParser::locateMazes and then parsed by a pool of workerThreads threads (0 means one per hardware thread).
+The results follow the order of the mazes within the image (by rows, then by columns).
+Throws domain_error when the image contains no maze.
+*/
+std::vector<LoadedMaze> loadAllMazes(const std::string &imageFile,
+									 unsigned workerThreads = 0U, bool verbose = false);
+
+/// Same as above, for an already decoded BGR image. imageName just identifies the image within the names of the mazes
+std::vector<LoadedMaze> loadAllMazes(const cv::Mat &bgrImg, const std::string &imageName,
+									 unsigned workerThreads = 0U, bool verbose = false);
+
+/**
+Parses an image maze for which the default thresholds might not fit.
+The image is decoded once and then parsed concurrently with each of ImageMazeParser::thresholdsPortfolio, on separate threads.
+The parses are strict (see ImageParsingBuffers::strict) and the result comes from the first thresholds set (in the portfolio order)
+producing a consistent maze. The parses using later sets are abandoned as soon as such a result is available.
+Throws domain_error when none of the sets works.
+*/
+std::shared_ptr<const Maze> loadMazeRobustly(const std::string &mazeFile, bool verbose = false);
+
+#endif // H_MAZE_BATCH
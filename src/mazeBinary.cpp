@@ -0,0 +1,172 @@
+/******************************************************************
+ Project TiltedMaze solves tilted maze problems.
+
+ You might visit http://www.agame.com/game/tilt-maze
+ to try yourself solving such problems (use the arrow keys to move)
+
+ The program is able to load the puzzle from text files, but also
+ from captured snapshots, which contain various imperfections.
+ It is possible to recognize the original maze even when rotating,
+ mirroring the snapshot, or even after applying perspective
+ transformations on it.
+ 
+ Solving the maze is presented as an animation, either on console,
+ or within a normal window.
+
+ The project uses OpenCV and Boost.
+
+ Copyright (c) 2014, 2017 Florin Tulba
+
+*******************************************************************/
+
+#include "mazeBinary.h"
+#include "mazeInput.h"
+
+#pragma warning( push, 0 )
+
+#include <cstring>
+#include <fstream>
+
+#pragma warning( pop )
+
+using namespace std;
+using namespace boost::icl;
+
+namespace {
+	const char binaryMazeSignature[] = { 'T', 'M', 'Z', 'B' };
+
+	/// Bytes of a bitmap with a bit for each of the cells of a row / column
+	inline size_t bitmapBytes(unsigned cellsCount) {
+		return ((size_t)cellsCount + 7ULL) / 8ULL;
+	}
+
+	/// Turns the bits of a row / column into the intervals between its walls, appending them in order
+	split_interval_set<unsigned> intervalsFromBitmap(const UINT8 *bitmap, unsigned cellsCount) {
+		split_interval_set<unsigned> sis;
+		unsigned from = 0U;
+		for(unsigned cell = 0U; cell + 1U < cellsCount; ++cell) { // a wall after the last cell is implicit
+			if(0U == (bitmap[cell >> 3] & (1U << (cell & 7U))))
+				continue;
+
+			sis.add(sis.end(), interval<unsigned>::type(from, cell + 1U)); // the hint makes appending constant-time
+			from = cell + 1U;
+		}
+		sis.add(sis.end(), interval<unsigned>::type(from, cellsCount));
+		return sis;
+	}
+
+	/// Sets the bits of the walls separating the intervals of a row / column
+	void bitmapFromIntervals(const split_interval_set<unsigned> &sis, unsigned cellsCount, vector<UINT8> &bitmap) {
+		bitmap.assign(bitmapBytes(cellsCount), (UINT8)0U);
+		for(const auto &limPair : sis) {
+			const unsigned wall = limPair.upper();
+			if(wall > 0U && wall < cellsCount)
+				bitmap[(wall - 1U) >> 3] |= UINT8(1U << ((wall - 1U) & 7U));
+		}
+	}
+}
+
+bool BinaryMazeParser::recognizes(const ByteSpan &content) {
+	return content.size >= sizeof(binaryMazeSignature) &&
+		0 == memcmp(content.data, binaryMazeSignature, sizeof(binaryMazeSignature));
+}
+
+void BinaryMazeParser::process(const ByteSpan &content, bool verbose/* = false*/) {
+	if(false == recognizes(content) || content.size < sizeof(BinaryMazeHeader))
+		throw invalid_argument("The provided content isn't a binary maze!");
+
+	BinaryMazeHeader header;
+	memcpy(&header, content.data, sizeof header);
+	if(header.version != BinaryMazeHeader::CURRENT_VERSION)
+		throw invalid_argument("Unsupported version of the binary maze format!");
+
+	rowsCount = header.rowsCount;
+	columnsCount = header.columnsCount;
+	if(rowsCount==0U || columnsCount==0U)
+		throw out_of_range("Read invalid maze size!");
+
+	const size_t rowBytes = bitmapBytes(columnsCount), columnBytes = bitmapBytes(rowsCount),
+		targetsBytes = (size_t)header.targetsCount * 2ULL * sizeof(UINT32);
+	if(content.size != sizeof(BinaryMazeHeader) + targetsBytes + rowBytes * rowsCount + columnBytes * columnsCount)
+		throw invalid_argument("The size of the binary maze doesn't match its header!");
+
+	if(verbose) {
+		PRINTLN(rowsCount);
+		PRINTLN(columnsCount);
+	}
+
+	startLocation = Coord(header.startRow, header.startColumn);
+	if(startLocation.row>=rowsCount || startLocation.col>=columnsCount)
+		throw out_of_range("The provided maze file specifies an invalid starting location given the configured maze dimensions!");
+
+	if(0U == header.targetsCount)
+		throw domain_error("The provided maze file doesn't specify any targets!");
+
+	// Coord holds the row and the column just like the targets array
+	const char *data = content.data + sizeof(BinaryMazeHeader);
+	targets.resize((size_t)header.targetsCount);
+	memcpy(targets.data(), data, targetsBytes);
+	for(const auto &target : targets)
+		if(target.row>=rowsCount || target.col>=columnsCount)
+			throw out_of_range("The provided maze file specifies an invalid target given the configured maze dimensions!");
+	data += targetsBytes;
+
+	rows.reserve(rowsCount);
+	for(unsigned i = 0U; i<rowsCount; ++i, data += rowBytes)
+		rows.push_back(intervalsFromBitmap(reinterpret_cast<const UINT8*>(data), columnsCount));
+
+	columns.reserve(columnsCount);
+	for(unsigned i = 0U; i<columnsCount; ++i, data += columnBytes)
+		columns.push_back(intervalsFromBitmap(reinterpret_cast<const UINT8*>(data), rowsCount));
+
+	if(verbose)
+	 	cout<<"startLocation coords: "<<startLocation.row<<','<<startLocation.col<<endl<<
+			"targets count: "<<targets.size()<<endl<<"File was correct!"<<endl;
+}
+
+BinaryMazeParser::BinaryMazeParser(const ByteSpan &content,
+								   unsigned &rowsCount,
+								   unsigned &columnsCount,
+								   Coord &startLocation,
+								   vector<Coord> &targets,
+								   vector<split_interval_set<unsigned>> &rows,
+								   vector<split_interval_set<unsigned>> &columns,
+								   bool verbose/* = false*/) :
+		rowsCount(rowsCount), columnsCount(columnsCount), startLocation(startLocation), targets(targets), rows(rows), columns(columns) {
+	static_assert(sizeof(Coord) == 2ULL * sizeof(UINT32), "The targets are copied directly as Coord-s");
+	process(content, verbose);
+}
+
+void saveBinaryMaze(const Maze &maze, ostream &os) {
+	BinaryMazeHeader header;
+	memset(&header, 0, sizeof header);
+	memcpy(header.signature, binaryMazeSignature, sizeof(binaryMazeSignature));
+	header.version = (UINT16)BinaryMazeHeader::CURRENT_VERSION;
+	header.rowsCount = maze.rowsCount();
+	header.columnsCount = maze.columnsCount();
+	header.startRow = maze.startLocation().row;
+	header.startColumn = maze.startLocation().col;
+	header.targetsCount = (UINT32)maze.targets().size();
+	os.write(reinterpret_cast<const char*>(&header), sizeof header);
+	os.write(reinterpret_cast<const char*>(maze.targets().data()), (streamsize)(maze.targets().size() * sizeof(Coord)));
+
+	vector<UINT8> bitmap;
+	for(const auto &sis : maze.rows()) {
+		bitmapFromIntervals(sis, maze.columnsCount(), bitmap);
+		os.write(reinterpret_cast<const char*>(bitmap.data()), (streamsize)bitmap.size());
+	}
+	for(const auto &sis : maze.columns()) {
+		bitmapFromIntervals(sis, maze.rowsCount(), bitmap);
+		os.write(reinterpret_cast<const char*>(bitmap.data()), (streamsize)bitmap.size());
+	}
+}
+
+void convertToBinaryMaze(const string &mazeFile, const string &binaryFile, bool verbose/* = false*/) {
+	const Maze maze(mazeFile, verbose);
+
+	ofstream ofs(binaryFile, ios::binary);
+	saveBinaryMaze(maze, ofs);
+	ofs.close();
+	if(ofs.fail())
+		throw runtime_error("Couldn't write the binary maze " + binaryFile);
+}
@@ -0,0 +1,92 @@
+/******************************************************************
+ Project TiltedMaze solves tilted maze problems.
+
+ You might visit http://www.agame.com/game/tilt-maze
+ to try yourself solving such problems (use the arrow keys to move)
+
+ The program is able to load the puzzle from text files, but also
+ from captured snapshots, which contain various imperfections.
+ It is possible to recognize the original maze even when rotating,
+ mirroring the snapshot, or even after applying perspective
+ transformations on it.
+ 
+ Solving the maze is presented as an animation, either on console,
+ or within a normal window.
+
+ The project uses OpenCV and Boost.
+
+ Copyright (c) 2014, 2017 Florin Tulba
+
+*******************************************************************/
+
+#ifndef H_MAZE_BINARY
+#define H_MAZE_BINARY
+
+#include "mazeStruct.h"
+
+#pragma warning( push, 0 )
+
+#include <string>
+#include <ostream>
+
+#pragma warning( pop )
+
+#pragma pack( push, 1 )
+
+/**
+Start of a maze in the compact binary format (.tmz files), which is followed by:
+- targetsCount pairs of UINT32 - the row and the column of each target
+- rowsCount bitmaps of (columnsCount + 7) / 8 bytes: bit k (the least significant first) is set when a wall follows the cell k of the row
+- columnsCount bitmaps of (rowsCount + 7) / 8 bytes: bit k is set when a wall follows the cell k of the column
+All numbers are little-endian, so the content is used directly, without any parsing.
+*/
+struct BinaryMazeHeader {
+	enum { CURRENT_VERSION = 1 };
+
+	char signature[4];		///< "TMZB"
+	UINT16 version;			///< the version of the format
+	UINT16 reserved;		///< 0 for now
+	UINT32 rowsCount, columnsCount;
+	UINT32 startRow, startColumn;
+	UINT32 targetsCount;
+	UINT32 reserved2;		///< 0 for now; keeps the targets aligned
+};
+
+#pragma pack( pop )
+
+/// Loads a maze from the compact binary format
+class BinaryMazeParser {
+	unsigned &rowsCount, &columnsCount;
+
+	Coord &startLocation;
+	std::vector<Coord> &targets;
+
+	std::vector<boost::icl::split_interval_set<unsigned>> &rows, &columns;
+
+	void process(const ByteSpan &content, bool verbose = false);
+
+public:
+	/// Checks the signature of the binary format
+	static bool recognizes(const ByteSpan &content);
+
+	/// Loads a maze already in memory, like a mapped .tmz file
+	BinaryMazeParser(const ByteSpan &content,
+					 unsigned &rowsCount,
+					 unsigned &columnsCount,
+					 Coord &startLocation,
+					 std::vector<Coord> &targets,
+					 std::vector<boost::icl::split_interval_set<unsigned>> &rows,
+					 std::vector<boost::icl::split_interval_set<unsigned>> &columns,
+					 bool verbose = false);
+};
+
+/// Writes the maze in the compact binary format
+void saveBinaryMaze(const Maze &maze, std::ostream &os);
+
+/**
+Converts a maze from any supported source (text or image) into a .tmz file.
+Throws runtime_error when the binary file can't be written.
+*/
+void convertToBinaryMaze(const std::string &mazeFile, const std::string &binaryFile, bool verbose = false);
+
+#endif // H_MAZE_BINARY
\ No newline at end of file
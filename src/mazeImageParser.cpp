@@ -20,15 +20,119 @@
 *******************************************************************/
 
 #include "mazeImageParser.h"
+#include "mazeInput.h"
+
+#pragma warning( push, 0 )
+
+#include <intrin.h>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <set>
+
+#pragma warning( pop )
 
 using namespace std;
 using namespace cv;
 using namespace boost;
 using namespace boost::icl;
 
+namespace {
+	enum { PIXELS_PER_VECTOR = 16 };
+	enum { ROWS_PER_TILE = 32 }; ///< image rows processed by the same thread
+	enum { PROBED_LINES_PER_TILE = 2 }; ///< lines probed by the same thread within ImageMazeParser::isolateWalls
+	enum { CELL_ROWS_PER_TILE = 4 }; ///< rows of cells classified by the same thread
+
+	/// Adapts a function handling the tiles [fromRow, toRow) to cv::parallel_for_, which in OpenCV 3.0 doesn't accept lambdas
+	class RowTilesBody : public ParallelLoopBody {
+		const function<void(int tile, int fromRow, int toRow)> &processTile;
+		int rowsCount, rowsPerTile;
+
+	public:
+		RowTilesBody(const function<void(int, int, int)> &processTile, int rowsCount, int rowsPerTile) :
+			processTile(processTile), rowsCount(rowsCount), rowsPerTile(rowsPerTile) {}
+
+		void operator()(const Range &tiles) const override {
+			for(int tile = tiles.start; tile < tiles.end; ++tile)
+				processTile(tile, tile * rowsPerTile, min((tile + 1) * rowsPerTile, rowsCount));
+		}
+	};
+
+	/// Count of the tiles covering rowsCount rows
+	inline int tilesCount(int rowsCount, int rowsPerTile) {
+		return (rowsCount + rowsPerTile - 1) / rowsPerTile;
+	}
+
+	/**
+	Processes in parallel the tiles of rowsPerTile consecutive rows (the last tile might be shorter).
+	The tiles are always the same for a given rowsCount, so results combined in tile order are deterministic.
+	*/
+	void forEachRowTile(int rowsCount, const function<void(int tile, int fromRow, int toRow)> &processTile,
+						int rowsPerTile = ROWS_PER_TILE) {
+		const int tiles = tilesCount(rowsCount, rowsPerTile);
+		const RowTilesBody body(processTile, rowsCount, rowsPerTile);
+		if(tiles > 1)
+			parallel_for_(Range(0, tiles), body, tiles);
+		else if(tiles == 1)
+			body(Range(0, 1)); // not worth involving other threads
+	}
+
+	/// Loads 16 BGR pixels and separates their channels
+	void loadBgrPixels(const UINT8 *bgrPixels, __m128i &blue, __m128i &green, __m128i &red) {
+		const __m128i chunk0 = _mm_loadu_si128((const __m128i*)bgrPixels),
+			chunk1 = _mm_loadu_si128((const __m128i*)(bgrPixels + 16)),
+			chunk2 = _mm_loadu_si128((const __m128i*)(bgrPixels + 32));
+
+		// Each channel gets 5 or 6 bytes from every chunk; -1 marks the bytes provided by the other chunks
+		blue = _mm_or_si128(_mm_or_si128(
+			_mm_shuffle_epi8(chunk0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+			_mm_shuffle_epi8(chunk1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+			_mm_shuffle_epi8(chunk2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+		green = _mm_or_si128(_mm_or_si128(
+			_mm_shuffle_epi8(chunk0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+			_mm_shuffle_epi8(chunk1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+			_mm_shuffle_epi8(chunk2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+		red = _mm_or_si128(_mm_or_si128(
+			_mm_shuffle_epi8(chunk0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+			_mm_shuffle_epi8(chunk1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+			_mm_shuffle_epi8(chunk2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+	}
+
+	// Unsigned byte comparisons (SSE provides only signed ones)
+	inline __m128i lessOrEqual(const __m128i &a, const __m128i &b) { return _mm_cmpeq_epi8(_mm_min_epu8(a, b), a); }
+	inline __m128i greaterOrEqual(const __m128i &a, const __m128i &b) { return _mm_cmpeq_epi8(_mm_max_epu8(a, b), a); }
+	inline __m128i lessThan(const __m128i &a, const __m128i &b) { return _mm_andnot_si128(greaterOrEqual(a, b), _mm_set1_epi8(-1)); }
+	inline __m128i greaterThan(const __m128i &a, const __m128i &b) { return _mm_andnot_si128(lessOrEqual(a, b), _mm_set1_epi8(-1)); }
+
+	/// Brightness (the maximum channel) of a BGR image at a subpixel position, using bilinear interpolation. Returns -1 outside the image
+	double brightnessAt(const Mat &bgrImg, const Point2d &pos) {
+		const int x = cvFloor(pos.x), y = cvFloor(pos.y);
+		if(x < 0 || y < 0 || x + 1 >= bgrImg.cols || y + 1 >= bgrImg.rows)
+			return -1.;
+
+		const double fx = pos.x - x, fy = pos.y - y;
+		const auto brightness = [&] (int row, int col) {
+			const Vec3b &pixel = bgrImg.at<Vec3b>(row, col);
+			return (double)max(max(pixel[0], pixel[1]), pixel[2]);
+		};
+		return (1. - fy) * ((1. - fx) * brightness(y, x) + fx * brightness(y, x + 1)) +
+			fy * ((1. - fx) * brightness(y + 1, x) + fx * brightness(y + 1, x + 1));
+	}
+}
+
 const Mat ImageMazeParser::structuralElem = getStructuringElement(MORPH_RECT, Size(3, 3));
 
-map<int, Point2f> ImageMazeParser::cornersIdxMap;
+const vector<ParsingThresholds> ImageMazeParser::thresholdsPortfolio {
+	ParsingThresholds(),
+	ParsingThresholds(235U, 70U, 120U, 95U),	// washed out images
+	ParsingThresholds(170U, 40U, 50U, 130U),	// underexposed images
+	ParsingThresholds(210U, 55U, 80U, 80U)		// faded tokens
+};
+
+vector<Point2f> ImageMazeParser::idealCorners(int side) {
+	const float last = (float)(side - 1);
+	return vector<Point2f> { Point2f(last, 0.f), Point2f(0.f, 0.f), Point2f(0.f, last), Point2f(last, last) };
+}
 
 // Based on the nearest segment to the header and the header's slight left position, it's possible to straighten the maze
 // by mapping its corners to their expected position
@@ -60,25 +164,61 @@ bool ImageMazeParser::linesIntersection(const Point2d &a1, const Point2d &a2, co
 	return true;
 }
 
-bool ImageMazeParser::redOrBlue(UINT8 red, UINT8 green, UINT8 blue, UINT8 threshold/* = 128U*/) {
+bool ImageMazeParser::RedOrBlue::pixel(UINT8 red, UINT8 green, UINT8 blue, UINT8 threshold/* = 128U*/) {
 	return (green < threshold) && (min(red, blue) < threshold) && (max(red, blue) >= threshold);
 }
 
-bool ImageMazeParser::justRed(UINT8 red, UINT8 green, UINT8 blue, UINT8 threshold/* = 128U*/) {
+__m128i ImageMazeParser::RedOrBlue::pixels(const __m128i &red, const __m128i &green, const __m128i &blue, const __m128i &threshold) {
+	return _mm_and_si128(_mm_and_si128(lessThan(green, threshold),
+									   lessThan(_mm_min_epu8(red, blue), threshold)),
+						 greaterOrEqual(_mm_max_epu8(red, blue), threshold));
+}
+
+bool ImageMazeParser::JustRed::pixel(UINT8 red, UINT8 green, UINT8 blue, UINT8 threshold/* = 128U*/) {
 	return (red > threshold) && (blue <= threshold) && (green <= threshold);
 }
 
-bool ImageMazeParser::justBlue(UINT8 red, UINT8 green, UINT8 blue, UINT8 threshold/* = 128U*/) {
+__m128i ImageMazeParser::JustRed::pixels(const __m128i &red, const __m128i &green, const __m128i &blue, const __m128i &threshold) {
+	return _mm_and_si128(greaterThan(red, threshold),
+						 lessOrEqual(_mm_max_epu8(blue, green), threshold));
+}
+
+bool ImageMazeParser::JustBlue::pixel(UINT8 red, UINT8 green, UINT8 blue, UINT8 threshold/* = 128U*/) {
 	return (blue > threshold) && (red <= threshold) && (green <= threshold);
 }
 
-bool ImageMazeParser::findPixel(Mat rgbImg, PixCondition pixCondFun, Point &foundPixel, int samplingStep/* = 1*/, UINT8 threshold/* = 128U*/) {
-	for(int r = 0; r<rgbImg.rows; r += samplingStep) {
-		for(int c = 0; c<rgbImg.cols; c += samplingStep) {
+__m128i ImageMazeParser::JustBlue::pixels(const __m128i &red, const __m128i &green, const __m128i &blue, const __m128i &threshold) {
+	return _mm_and_si128(greaterThan(blue, threshold),
+						 lessOrEqual(_mm_max_epu8(red, green), threshold));
+}
 
-			Vec3b pixel = rgbImg.at<Vec3b>(r, c);
+template<class PixCondition>
+bool ImageMazeParser::findPixel(const Mat &bgrImg, Point &foundPixel, int samplingStep/* = 1*/, UINT8 threshold/* = 128U*/) {
+	const bool vectorized = checkHardwareSupport(CV_CPU_SSSE3);
+	const __m128i thresholds = _mm_set1_epi8((char)threshold);
+	const int lastVectorStart = bgrImg.cols - PIXELS_PER_VECTOR;
+
+	for(int r = 0; r<bgrImg.rows; r += samplingStep) {
+		const UINT8 *rowPixels = bgrImg.ptr<UINT8>(r);
+		int c = 0;
+
+		if(vectorized) {
+			__m128i blue, green, red;
+			for(; c <= lastVectorStart; c += PIXELS_PER_VECTOR) {
+				loadBgrPixels(rowPixels + 3 * c, blue, green, red);
+				const int matches = _mm_movemask_epi8(PixCondition::pixels(red, green, blue, thresholds));
+				if(matches != 0) {
+					unsigned long firstMatch = 0UL;
+					_BitScanForward(&firstMatch, (unsigned long)matches);
+					foundPixel = Point(c + (int)firstMatch, r); // Point holds the flipped coordinates
+					return true;
+				}
+			}
+		}
 
-			if(pixCondFun(pixel[chRed], pixel[chGreen], pixel[chBlue], threshold)) {
+		// the pixels left after the vectorized part (all of them when SSSE3 isn't available)
+		for(const UINT8 *pixel = rowPixels + 3 * c; c < bgrImg.cols; ++c, pixel += 3) {
+			if(PixCondition::pixel(pixel[2], pixel[1], pixel[0], threshold)) {
 				foundPixel = Point(c, r); // Point holds the flipped coordinates
 				return true;
 			}
@@ -88,44 +228,182 @@ bool ImageMazeParser::findPixel(Mat rgbImg, PixCondition pixCondFun, Point &foun
 	return false;
 }
 
+void ImageMazeParser::classifyPixels(const Mat &bgrImg,
+									 UINT8 darkThreshold, UINT8 maxRedBlueDiff, UINT8 tokenThreshold,
+									 Mat *darkMask, Mat *grayishDarkMask/* = nullptr*/,
+									 Mat *redMask/* = nullptr*/, Mat *blueMask/* = nullptr*/) {
+	Mat * const masks[] = { darkMask, grayishDarkMask, redMask, blueMask };
+	for(Mat *mask : masks)
+		if(nullptr != mask)
+			mask->create(bgrImg.rows, bgrImg.cols, CV_8UC1); // no reallocation for a reused mask of the same size
+
+	const bool vectorized = checkHardwareSupport(CV_CPU_SSSE3);
+	const __m128i darkThresholds = _mm_set1_epi8((char)darkThreshold),
+		maxRedBlueDiffs = _mm_set1_epi8((char)maxRedBlueDiff),
+		tokenThresholds = _mm_set1_epi8((char)tokenThreshold);
+	const int lastVectorStart = bgrImg.cols - PIXELS_PER_VECTOR;
+
+	// Every row is classified independently, so the row tiles are handled in parallel
+	forEachRowTile(bgrImg.rows, [&] (int, int fromRow, int toRow) {
+		for(int r = fromRow; r<toRow; ++r) {
+			const UINT8 *rowPixels = bgrImg.ptr<UINT8>(r);
+			UINT8 *darkRow = (nullptr != darkMask) ? darkMask->ptr<UINT8>(r) : nullptr,
+				*grayishDarkRow = (nullptr != grayishDarkMask) ? grayishDarkMask->ptr<UINT8>(r) : nullptr,
+				*redRow = (nullptr != redMask) ? redMask->ptr<UINT8>(r) : nullptr,
+				*blueRow = (nullptr != blueMask) ? blueMask->ptr<UINT8>(r) : nullptr;
+			int c = 0;
+
+			if(vectorized) {
+				__m128i blue, green, red;
+				for(; c <= lastVectorStart; c += PIXELS_PER_VECTOR) {
+					loadBgrPixels(rowPixels + 3 * c, blue, green, red);
+					const __m128i dark = lessThan(_mm_max_epu8(_mm_max_epu8(blue, green), red), darkThresholds);
+					if(nullptr != darkRow)
+						_mm_storeu_si128((__m128i*)(darkRow + c), dark);
+					if(nullptr != grayishDarkRow) {
+						_mm_storeu_si128((__m128i*)(grayishDarkRow + c),
+										 _mm_and_si128(dark, lessThan(_mm_max_epu8(_mm_subs_epu8(red, blue), _mm_subs_epu8(blue, red)),
+																	  maxRedBlueDiffs))); // |red - blue|
+					}
+					if(nullptr != redRow)
+						_mm_storeu_si128((__m128i*)(redRow + c), JustRed::pixels(red, green, blue, tokenThresholds));
+					if(nullptr != blueRow)
+						_mm_storeu_si128((__m128i*)(blueRow + c), JustBlue::pixels(red, green, blue, tokenThresholds));
+				}
+			}
+
+			// the pixels left after the vectorized part (all of them when SSSE3 isn't available)
+			for(const UINT8 *pixel = rowPixels + 3 * c; c < bgrImg.cols; ++c, pixel += 3) {
+				const UINT8 blue = pixel[0], green = pixel[1], red = pixel[2];
+				const bool dark = max(max(blue, green), red) < darkThreshold;
+				if(nullptr != darkRow)
+					darkRow[c] = dark ? 255U : 0U;
+				if(nullptr != grayishDarkRow)
+					grayishDarkRow[c] = (dark && abs((int)red - (int)blue) < (int)maxRedBlueDiff) ? 255U : 0U;
+				if(nullptr != redRow)
+					redRow[c] = JustRed::pixel(red, green, blue, tokenThreshold) ? 255U : 0U;
+				if(nullptr != blueRow)
+					blueRow[c] = JustBlue::pixel(red, green, blue, tokenThreshold) ? 255U : 0U;
+			}
+		}
+	});
+}
+
 void ImageMazeParser::process(const string &fileName) {
-	originalImg = imread(fileName);
-	if(originalImg.data == nullptr)
+	// Decoding from the mapped file into originalImg reuses its allocation when the size matches (imread always allocates)
+	Mat decoded;
+	try {
+		MappedFile mappedFile(fileName);
+		decoded = decode(mappedFile.bytes(), &originalImg);
+	} catch(invalid_argument&) {} // missing or empty file
+
+	if(decoded.data == nullptr)
 		throw invalid_argument("The provided file isn't a valid image!");
 
+	process();
+}
+
+Mat ImageMazeParser::decode(const ByteSpan &content, Mat *reusedImg/* = nullptr*/) {
+	const Mat encoded(1, (int)content.size, CV_8UC1, const_cast<char*>(content.data)); // just wraps the content
+
+	int reduction = 1;
+	unsigned width = 0U, height = 0U;
+	if(content.imageSize(width, height)) {
+		// the smallest cell side expected before reduction: a maze with the most cells, spanning the least share of the image
+		const unsigned minCellSide = min(width, height) * (unsigned)MIN_DECODED_MAZE_SHARE_PERCENT /
+			(100U * (unsigned)(MAX_STRAIGHT_SIDE / TARGET_CELL_SIDE));
+		while(reduction < MAX_DECODE_REDUCTION && minCellSide / (2U * (unsigned)reduction) >= (unsigned)MIN_CELL_SIDE)
+			reduction *= 2;
+	}
+
+	int flags = IMREAD_COLOR;
+	bool reducedByDecoder = false;
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 2)
+	// the jpeg decoder skips the details lost by the reduction, which is much faster than decoding everything
+	if(reduction > 1 && content.isJpeg()) {
+		flags = (reduction == 2) ? IMREAD_REDUCED_COLOR_2 : ((reduction == 4) ? IMREAD_REDUCED_COLOR_4 : IMREAD_REDUCED_COLOR_8);
+		reducedByDecoder = true;
+	}
+#endif // OpenCV 3.2+
+
+	if(reduction == 1 || reducedByDecoder)
+		return (nullptr != reusedImg) ? imdecode(encoded, flags, reusedImg) : imdecode(encoded, flags);
+
+	// Otherwise the image gets reduced right after decoding, so all the later passes handle the reduced image
+	const Mat fullImg = imdecode(encoded, flags);
+	if(fullImg.empty())
+		return fullImg;
+
+	Mat reducedImg;
+	Mat &result = (nullptr != reusedImg) ? *reusedImg : reducedImg;
+	resize(fullImg, result, Size(), 1. / reduction, 1. / reduction, INTER_AREA);
+	return result;
+}
+
+void ImageMazeParser::process() {
 	if(originalImg.type() != CV_8UC3)
 		throw invalid_argument("The image isn't a standard RGB image!");
 
 	straightenMaze();
+	parseStraightenedMaze();
+}
 
-	enum { MAX_BLACK_THRESHOLD = 80, MIN_BLUE_THRESHOLD = 110 }; // adjusted to suit the provided mazes
+void ImageMazeParser::process(const MazeLocation &location) {
+	if(originalImg.type() != CV_8UC3)
+		throw invalid_argument("The image isn't a standard RGB image!");
+
+	straightenLocatedMaze(location);
+	parseStraightenedMaze();
+}
 
-	vector<Mat> channels;
-	split(straightImg, channels);
-	Mat wallsGross = (max(max(channels[chRed], channels[chBlue]), channels[chGreen]) < MAX_BLACK_THRESHOLD);
+void ImageMazeParser::parseStraightenedMaze() {
+	checkAbandoned();
 
-	Mat walls4BetterDetection, walls4Integration, wallsIntegral; // wallsIntegral will have an extra line and column compared to wallsGross
+	const ParsingThresholds &thresholds = buffers.thresholds;
+	const bool sparse = false == straightToOriginal.empty(); // straightImg wasn't computed
 
-	// Preparing for integration and better detection
-	dilate(wallsGross, walls4BetterDetection, structuralElem); // fills the teeth of comb-like walls => sharpens the integral's slope when meeting the segment
+	vector<double> vProfile, hProfile; // the walls projections on the horizontal / vertical axis
+	if(sparse) {
+		sampledWallsProjections(vProfile, hProfile);
+
+		if(verbose)
+			debugImg = Mat::zeros(straightSide, straightSide, CV_8UC1); // just the detected items are drawn
+
+	} else {
+		Mat &wallsGross = buffers.wallsGross;
+		classifyPixels(straightImg, thresholds.wallsMaxBlack, 0U, 0U, &wallsGross);
 
-	debugImg = walls4BetterDetection.clone();
+		Mat &walls4BetterDetection = buffers.walls4BetterDetection;
 
-	erode(walls4BetterDetection, walls4Integration, structuralElem, Point(-1, -1), 2); // reduces the count of segment end pixels that are counted on perpendicular direction => less interference produced by perpendicular segments
+		// Preparing for projection and better detection
+		dilate(wallsGross, walls4BetterDetection, structuralElem); // fills the teeth of comb-like walls => sharpens the projections' slope when meeting the segment
 
-	walls4Integration.convertTo(walls4Integration, CV_64F,
-								1./(255 * countNonZero(walls4Integration))); // ensures the integrals bottom right corner is 1
-	integral(walls4Integration, wallsIntegral);
+		if(verbose)
+			walls4BetterDetection.copyTo(debugImg);
 
-	// Traversing the base of the wallsIntegral and marking the walls
+		Mat &wallsEroded = buffers.wallsEroded;
+		erode(walls4BetterDetection, wallsEroded, structuralElem, Point(-1, -1), 2); // reduces the count of segment end pixels that are counted on perpendicular direction => less interference produced by perpendicular segments
+
+		wallsProjections(wallsEroded, vProfile, hProfile);
+	}
+
+	// Traversing the walls projections and marking the walls
 	vector<int> vWallsCoords, hWallsCoords;
 	int vTol = 0, hTol = 0; // tolerance for vertical / horizontal walls, considering also misplaced (shifted) walls
 
-	extractWallsCoords(wallsIntegral, true, vWallsCoords, vTol);
-	extractWallsCoords(wallsIntegral, false, hWallsCoords, hTol);
+	const int minCellSide = max(1, (int)(MIN_CELL_SIDE * cellScale + .5));
+	extractWallsCoords(vProfile, minCellSide, vWallsCoords, vTol);
+	extractWallsCoords(hProfile, minCellSide, hWallsCoords, hTol);
 
 	double deltaH = 0., deltaV = 0.;
-	size_t n = rowsCount = columnsCount = (unsigned)find1stFeasibleMazeSize(hWallsCoords, deltaH, vWallsCoords, deltaV);
+	size_t n = rowsCount = columnsCount = (unsigned)find1stFeasibleMazeSize(hWallsCoords, deltaH, vWallsCoords, deltaV,
+																					estimateGridPeriod(vProfile, hProfile, max(1, minCellSide / 2)));
+
+	enum { MAX_CELL_SIDES_DIFF_PERCENT = 10 };
+	if(buffers.strict && abs(deltaH - deltaV) * 100. > MAX_CELL_SIDES_DIFF_PERCENT * max(deltaH, deltaV))
+		throw domain_error("The detected cells aren't square!");
+
+	checkAbandoned();
 
 	int lim = (int)n, offsetCenterH = (int)(hWallsCoords[0] + deltaH/2 + .5), offsetCenterV = (int)(vWallsCoords[0] + deltaV/2 + .5);
 	vector<int> idealCentersH((size_t)lim), idealCentersV((size_t)lim);
@@ -134,105 +412,618 @@ void ImageMazeParser::process(const string &fileName) {
 		idealCentersH[(size_t)i] = (int)(.5 + nthIdealWallCoord(offsetCenterH, deltaH, i));
 	}
 
-	isolateWalls(walls4BetterDetection, true, n, vWallsCoords, deltaV, vTol, idealCentersH);
-	isolateWalls(walls4BetterDetection, false, n, hWallsCoords, deltaH, hTol, idealCentersV);
+	if(sparse)
+		sampleProbedLines(idealCentersH, true);
+	isolateWalls(true, n, vWallsCoords, deltaV, vTol, idealCentersH);
+	if(sparse)
+		sampleProbedLines(idealCentersV, false);
+	isolateWalls(false, n, hWallsCoords, deltaH, hTol, idealCentersV);
+
+	// the colors under the ideal centers of the cells: from straightImg or sampled from originalImg
+	Mat &cellColors = buffers.cellColors;
+	if(sparse) {
+		Mat &mapX = buffers.sampleMapX, &mapY = buffers.sampleMapY;
+		mapX.create(lim, lim, CV_32FC1);
+		mapY.create(lim, lim, CV_32FC1);
+		vector<Point2f> centers;
+		centers.reserve(n * n);
+		for(int r = 0; r < lim; ++r)
+			for(int c = 0; c < lim; ++c)
+				centers.emplace_back((float)idealCentersV[(size_t)c], (float)idealCentersH[(size_t)r]);
+		perspectiveTransform(centers, centers, straightToOriginal);
+		for(int r = 0; r < lim; ++r)
+			for(int c = 0; c < lim; ++c) {
+				const Point2f &center = centers[size_t(r * lim + c)];
+				mapX.at<float>(r, c) = center.x;
+				mapY.at<float>(r, c) = center.y;
+			}
+		remap(originalImg, cellColors, mapX, mapY, INTER_LINEAR);
+	}
+
+	// classifying in parallel the pixels under the ideal centers of each cell (for each row of cells)
+	const UINT8 minTokenIntensity = thresholds.minTokenIntensity;
+	enum { RED_OR_BLUE = 1, JUST_RED = 2, JUST_BLUE = 4 }; // flags for the classes of a cell center
+	vector<UINT8> cellClasses(n * n, (UINT8)0U);
+	forEachRowTile(lim, [&] (int, int fromRow, int toRow) {
+		for(unsigned r = (unsigned)fromRow; r < (unsigned)toRow; ++r) {
+			for(unsigned c = 0U; c<n; ++c) {
+				const Vec3b &pixel = sparse ? cellColors.at<Vec3b>((int)r, (int)c) : straightImg.at<Vec3b>(idealCentersH[r], idealCentersV[c]);
+				const UINT8 red = pixel[2], green = pixel[1], blue = pixel[0];
+				cellClasses[r * n + c] = UINT8((RedOrBlue::pixel(red, green, blue, minTokenIntensity) ? RED_OR_BLUE : 0) |
+											   (JustRed::pixel(red, green, blue, minTokenIntensity) ? JUST_RED : 0) |
+											   (JustBlue::pixel(red, green, blue, minTokenIntensity) ? JUST_BLUE : 0));
+			}
+		}
+	}, CELL_ROWS_PER_TILE);
 
-	// detecting the start location and the targets by checking the pixels under the ideal centers of each cell
+	// detecting the start location and the targets in row-major order, based on the classes of the cell centers
 	bool circleFound = false;
+	unsigned extraCircles = 0U; // red cells found after the start location
 	for(unsigned r = 0U; r<n; ++r) {
 		for(unsigned c = 0U; c<n; ++c) {
 			Point idealCellCenter(idealCentersV[c], idealCentersH[r]);
-			Vec3b pixel = straightImg.at<Vec3b>(idealCellCenter.y, idealCellCenter.x);
-			UINT8 red = pixel[2], green = pixel[1], blue = pixel[0];
+			const UINT8 cellClass = cellClasses[r * n + c];
 			
 			if(false == circleFound) {
-				if(false == redOrBlue(red, green, blue, MIN_BLUE_THRESHOLD))
+				if(0U == (cellClass & RED_OR_BLUE))
 					continue;
 
-				if(justRed(red, green, blue, MIN_BLUE_THRESHOLD)) {
+				if(0U != (cellClass & JUST_RED)) {
 					circleFound = true;
-					circle(debugImg, idealCellCenter, 15, 128U, CV_FILLED);
+					if(verbose)
+						circle(debugImg, idealCellCenter, (int)(15 * cellScale + .5), 128U, CV_FILLED);
 					startLocation = Coord(r, c);
 					continue;
 				}
+
+			} else if(0U != (cellClass & JUST_RED)) {
+				++extraCircles;
+				continue;
 			}
 
-			if(justBlue(red, green, blue, MIN_BLUE_THRESHOLD)) {
+			if(0U != (cellClass & JUST_BLUE)) {
 				targets.emplace_back(r, c);
 
-				Point p(4, 4);
-				rectangle(debugImg, idealCellCenter - p, idealCellCenter + p, 128U, CV_FILLED);
+				if(verbose) {
+					const int halfSide = max(1, (int)(4 * cellScale + .5));
+					Point p(halfSide, halfSide);
+					rectangle(debugImg, idealCellCenter - p, idealCellCenter + p, 128U, CV_FILLED);
+				}
 			}
 		}
 	}
+
+	if(buffers.strict) {
+		if(false == circleFound || extraCircles > 0U)
+			throw domain_error("Expected a single start location within the maze!");
+		if(targets.empty())
+			throw domain_error("No targets were found within the maze!");
+	}
 }
 
-Mat ImageMazeParser::preprocessImg(Point2d &headerCenter) {
-	enum { MAX_BLACK_THRESHOLD = 210, MAX_R_B_DIFF = 55 }; // adjusted to suit the provided mazes
-	vector<Mat> channels;
+void ImageMazeParser::checkAbandoned() const {
+	if(buffers.abandoned && buffers.abandoned())
+		throw runtime_error("The parse was abandoned!");
+}
+
+vector<Point> ImageMazeParser::preprocessImg(const Mat &bgrImg, Point2d &headerCenter) {
+	enum { MAX_HEADER_DISTANCE_PERCENT = 50,	///< how far from the maze can be the header, relative to the maze's side
+		HEADER_DEPTH_PERCENT = 10,				///< how much farther than its nearest large component can extend the header, relative to the maze's side
+		MIN_HEADER_AREA_FRACTION = 4 };			///< the large header components have at least 1/4 of the area of the largest one
 
-	split(originalImg, channels);
-	Mat img = (max(max(channels[chRed], channels[chBlue]), channels[chGreen]) < MAX_BLACK_THRESHOLD) &
-		(abs(channels[chBlue] - channels[chRed]) < MAX_R_B_DIFF);
+	Mat &img = buffers.mazeMask;
+	classifyPixels(bgrImg, buffers.thresholds.mazeMaxBlack, buffers.thresholds.mazeMaxRedBlueDiff, 0U, nullptr, &img);
 
-	// We want to flood the interior of the maze and we need a point from its interior
+	// We want to locate the maze and we need a point from its interior
 	// The starting circle and the targets squares have some colors that appear strictly within the maze
 	// So, if we know a point of any of these squares or of the circle, then this point will be for sure within the maze's interior
 	Point firstRedOrBlue;
-	if(false == findPixel(originalImg, redOrBlue, firstRedOrBlue, 3/*, 128U*/)) // Find 1st red or blue pixel while searching each 4rd pixel
+	if(false == findPixel<RedOrBlue>(bgrImg, firstRedOrBlue, 3/*, 128U*/)) // Find 1st red or blue pixel while searching each 3rd row
 		throw domain_error("No red / blue pixel was found in this image! Please adjust the sampling and/or the threshold if the image is correct!");
 
-	// Below using 4-vicinity to be able to tackle really thin maze borders.
-	// However, 4-vicinity leaves some isolated pixels unfilled, which are removed with a Close operation below
-	img.at<UINT8>(firstRedOrBlue.y, firstRedOrBlue.x) = 0U; // Ensure the seed isn't White
-	floodFill(img, firstRedOrBlue, 255U, nullptr, Scalar(), Scalar(), FLOODFILL_FIXED_RANGE | 4); // Point takes flipped coordinates
-
-	// Header Maze does bother some processing stages, so it's useful to remove it:
-	Mat header = img.clone();
-	floodFill(header, firstRedOrBlue, 0U, nullptr, Scalar(), Scalar(), FLOODFILL_FIXED_RANGE | 4); // hiding the flooded maze; Point takes flipped coordinates
-	// temp contains now the header
-
-	img ^= header; // preserve only the flooded maze
+	// Flooding the interior of the maze, so that the maze becomes a single dark component containing the seed.
+	// Below using 4-vicinity for the light pixels to be able to tackle really thin maze borders
+	// (the same as the 8-vicinity used for the dark pixels while labeling them)
+	img.at<UINT8>(firstRedOrBlue.y, firstRedOrBlue.x) = 0U; // Ensure the seed isn't dark
+	Rect flooded;
+	floodFill(img, firstRedOrBlue, 255U, &flooded, Scalar(), Scalar(), FLOODFILL_FIXED_RANGE | 4); // Point takes flipped coordinates
+	if(flooded.x == 0 || flooded.y == 0 || flooded.br().x == img.cols || flooded.br().y == img.rows)
+		throw domain_error("Couldn't isolate the maze within the provided image! Please adjust thresholds if the image is correct!");
 
-	// the Close operation (dilation followed by erosion) to remove the isolated unflooded pixels
-	dilate(img, img, structuralElem);
+	Mat &labels = buffers.componentLabels, &stats = buffers.componentStats, &centroids = buffers.componentCentroids;
+	const int labelsCount = connectedComponentsWithStats(img, labels, stats, centroids, 8, CV_32S);
+	const int mazeLabel = labels.at<int>(firstRedOrBlue.y, firstRedOrBlue.x);
 
-	header &= ~img; // ensures temp doesn't contain maze pixels that couldn't be flooded during the last floodFill
+	compare(labels, mazeLabel, img, CMP_EQ);
+	vector<vector<Point>> contours;
+	findContours(img, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+	if(contours.size() != 1) // There should be only 1 shape and therefore a single contour!
+		throw domain_error("Couldn't isolate the maze within the provided image! Please adjust thresholds if the image is correct!");
 
-	erode(img, img, structuralElem); // the postponed erosion to complete the Close operation
+	// The header is made of the components from around the maze that are not much farther from it
+	// than the nearest sufficiently large component (so not some speck of noise)
+	const double mazeSide = max(stats.at<int>(mazeLabel, CC_STAT_WIDTH), stats.at<int>(mazeLabel, CC_STAT_HEIGHT));
+	vector<pair<double, int>> candidates; // the distance from the maze and the label of the components near enough to it
+	int largestArea = 0;
+	for(int label = 1; label < labelsCount; ++label) { // label 0 is for the light pixels
+		if(label == mazeLabel)
+			continue;
+
+		const Point2f centroid((float)centroids.at<double>(label, 0), (float)centroids.at<double>(label, 1));
+		const double dist = -pointPolygonTest(contours[0], centroid, true); // positive outside the maze
+		if(dist > 0. && dist * 100. <= MAX_HEADER_DISTANCE_PERCENT * mazeSide) {
+			candidates.emplace_back(dist, label);
+			largestArea = max(largestArea, stats.at<int>(label, CC_STAT_AREA));
+		}
+	}
 
+	double nearestLargeDist = numeric_limits<double>::max();
+	for(const auto &candidate : candidates)
+		if(stats.at<int>(candidate.second, CC_STAT_AREA) * MIN_HEADER_AREA_FRACTION >= largestArea)
+			nearestLargeDist = min(nearestLargeDist, candidate.first);
 
 	// Below comes a good estimation of the center of the header using minimum enclosing rectangle.
-	vector<Point> headerPixels; // required by minAreaRect
-	findNonZero(header, headerPixels);
-	try {
-		headerCenter = minAreaRect(headerPixels).center; // throws when the image is completely black
-	} catch(cv::Exception&) {
+	// The corners of the bounding boxes of the header's components are enough for it
+	vector<Point> headerPoints; // required by minAreaRect
+	for(const auto &candidate : candidates) {
+		if((candidate.first - nearestLargeDist) * 100. > HEADER_DEPTH_PERCENT * mazeSide)
+			continue;
+
+		const int label = candidate.second;
+		const Rect bounds(stats.at<int>(label, CC_STAT_LEFT), stats.at<int>(label, CC_STAT_TOP),
+						  stats.at<int>(label, CC_STAT_WIDTH), stats.at<int>(label, CC_STAT_HEIGHT));
+		const Point lastPixel = bounds.br() - Point(1, 1);
+		headerPoints.push_back(bounds.tl());
+		headerPoints.emplace_back(lastPixel.x, bounds.y);
+		headerPoints.emplace_back(bounds.x, lastPixel.y);
+		headerPoints.push_back(lastPixel);
+	}
+	if(headerPoints.empty())
 		throw domain_error("Couldn't isolate the 'header' of the maze within the provided image! Please adjust thresholds if the image is correct!");
+
+	headerCenter = minAreaRect(headerPoints).center;
+
+	return contours[0];
+}
+
+double ImageMazeParser::prescreen(const Mat &bgrImg, ImageParsingBuffers &buffers) {
+	enum { CHECKS_COUNT = 4, MIN_HEADER_PIXELS = 16 };
+
+	Mat &dark = buffers.thumbnailDark;
+	const double scale = (double)PRESCREEN_SIDE / max(bgrImg.rows, bgrImg.cols);
+	if(scale < 1.) {
+		// Averaging the image would blur the thin borders of the maze from high-resolution photos above the dark threshold.
+		// So the pixels are classified at full size and then reduced: any dark pixel keeps its thumbnail pixel dark,
+		// while the tokens (large areas) need to cover most of their thumbnail pixels
+		classifyPixels(bgrImg, buffers.thresholds.mazeMaxBlack, buffers.thresholds.mazeMaxRedBlueDiff, 128U, nullptr,
+					   &buffers.prescreenDark, &buffers.prescreenRed, &buffers.prescreenBlue);
+		resize(buffers.prescreenDark, dark, Size(), scale, scale, INTER_AREA);
+		resize(buffers.prescreenRed, buffers.thumbnailRed, Size(), scale, scale, INTER_AREA);
+		resize(buffers.prescreenBlue, buffers.thumbnailBlue, Size(), scale, scale, INTER_AREA);
+		threshold(dark, dark, 0., 255., THRESH_BINARY);
+		threshold(buffers.thumbnailRed, buffers.thumbnailRed, 127., 255., THRESH_BINARY);
+		threshold(buffers.thumbnailBlue, buffers.thumbnailBlue, 127., 255., THRESH_BINARY);
+
+	} else {
+		classifyPixels(bgrImg, buffers.thresholds.mazeMaxBlack, buffers.thresholds.mazeMaxRedBlueDiff, 128U, nullptr,
+					   &dark, &buffers.thumbnailRed, &buffers.thumbnailBlue);
 	}
 
-	return img;
+	const auto firstPixel = [] (const Mat &mask, Point &pixel) {
+		for(int r = 0; r < mask.rows; ++r) {
+			const UINT8 *row = mask.ptr<UINT8>(r);
+			for(int c = 0; c < mask.cols; ++c)
+				if(row[c] != 0U) {
+					pixel = Point(c, r);
+					return true;
+				}
+		}
+		return false;
+	};
+
+	int passedChecks = 0;
+	Point redPixel, bluePixel;
+	const bool redFound = firstPixel(buffers.thumbnailRed, redPixel), blueFound = firstPixel(buffers.thumbnailBlue, bluePixel);
+	if(redFound)
+		++passedChecks;
+	if(blueFound)
+		++passedChecks;
+	if(false == redFound && false == blueFound)
+		return 0.; // nothing to start from for checking the border and the header
+
+	// The interior of the maze flooded from the start location (or a target) mustn't reach the margins of the thumbnail
+	const Point seed = redFound ? redPixel : bluePixel;
+	dark.at<UINT8>(seed.y, seed.x) = 0U; // Ensure the seed isn't White
+	Rect interior;
+	floodFill(dark, seed, 128U, &interior, Scalar(), Scalar(), FLOODFILL_FIXED_RANGE | 4); // Point takes flipped coordinates
+
+	const int minMazeSide = PRESCREEN_SIDE / 16;
+	if(interior.x == 0 || interior.y == 0 || interior.br().x == dark.cols || interior.br().y == dark.rows ||
+			interior.width < minMazeSide || interior.height < minMazeSide)
+		return passedChecks / (double)CHECKS_COUNT;
+
+	++passedChecks;
+
+	// The header should leave dark pixels outside the maze and its border
+	const int margin = max(2, min(interior.width, interior.height) / 16);
+	const Rect maze(interior.x - margin, interior.y - margin, interior.width + 2 * margin, interior.height + 2 * margin);
+	int headerPixels = 0;
+	for(int r = 0; r < dark.rows; ++r) {
+		const UINT8 *row = dark.ptr<UINT8>(r);
+		for(int c = 0; c < dark.cols; ++c)
+			if(row[c] == 255U && false == maze.contains(Point(c, r)))
+				++headerPixels;
+	}
+	if(headerPixels >= MIN_HEADER_PIXELS)
+		++passedChecks;
+
+	return passedChecks / (double)CHECKS_COUNT;
 }
 
-void ImageMazeParser::detectMazeCorners(const Mat &img, vector<Point> &mazeCorners) {
-	vector<vector<Point>> contours;
-	findContours(img, contours, CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE);
-	if(contours.size() != 1) // There should be only 1 shape and therefore a single contour!
-		throw domain_error("Couldn't isolate the maze within the provided image! Please adjust thresholds if the image is correct!");
+vector<MazeLocation> ImageMazeParser::locateMazes(const Mat &bgrImg, ImageParsingBuffers &buffers) {
+	enum { MIN_MAZE_SIDE = 32, ///< within the analyzed image
+		MAX_HEADER_DISTANCE_PERCENT = 50 }; ///< how far from its maze can be a header blob, relative to the maze's side
+
+	int pyramidLevels = 0;
+	const Mat &img = pyramidReduced(bgrImg, buffers, pyramidLevels);
+
+	Mat &mazes = buffers.mazeMask, &header = buffers.headerMask, &tokens = buffers.tokensMask;
+	classifyPixels(img, buffers.thresholds.mazeMaxBlack, buffers.thresholds.mazeMaxRedBlueDiff, 128U, nullptr, &mazes, &tokens);
+
+	// Flooding the interior of each maze from its start location
+	// The floods reaching the margins are kept as REJECTED_FLOOD until all seeds were checked,
+	// so the other red pixels from the same region don't flood it again
+	enum { REJECTED_FLOOD = 64U, MAZE_FLOOD = 128U };
+	vector<Point> seeds;
+	for(int r = 0; r < tokens.rows; ++r) {
+		const UINT8 *tokensRow = tokens.ptr<UINT8>(r);
+		for(int c = 0; c < tokens.cols; ++c) {
+			if(tokensRow[c] == 0U || mazes.at<UINT8>(r, c) != 0U)
+				continue; // not a start location or within an already flooded maze
+
+			const Point seed(c, r); // Point takes flipped coordinates
+			Rect flooded;
+			floodFill(mazes, seed, MAZE_FLOOD, &flooded, Scalar(), Scalar(), FLOODFILL_FIXED_RANGE | 4);
+			if(flooded.x == 0 || flooded.y == 0 || flooded.br().x == mazes.cols || flooded.br().y == mazes.rows ||
+					flooded.width < MIN_MAZE_SIDE || flooded.height < MIN_MAZE_SIDE) {
+				floodFill(mazes, seed, REJECTED_FLOOD, nullptr, Scalar(), Scalar(), FLOODFILL_FIXED_RANGE | 4); // a red pixel outside any maze
+				continue;
+			}
+			seeds.push_back(seed);
+		}
+	}
+	threshold(mazes, mazes, REJECTED_FLOOD, 255., THRESH_BINARY); // the flooded interiors join the walls, while the rejected floods are cleared
+
+	// Separating the mazes from their headers: hiding the flooded mazes leaves just the headers
+	mazes.copyTo(header);
+	for(const auto &seed : seeds)
+		floodFill(header, seed, 0U, nullptr, Scalar(), Scalar(), FLOODFILL_FIXED_RANGE | 4);
+	mazes ^= header;
+	dilate(mazes, mazes, structuralElem);
+	header &= ~mazes;
+	erode(mazes, mazes, structuralElem);
+
+	// The contours of the mazes
+	vector<vector<Point>> contours, quads;
+	Mat &contoursImg = buffers.contoursMask;
+	mazes.copyTo(contoursImg); // findContours modifies its input
+	findContours(contoursImg, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+	for(const auto &contour : contours) {
+		vector<Point> quad;
+		approxPolyDP(contour, quad, arcLength(contour, true) * .02, true);
+		const Rect bounds = boundingRect(quad);
+		if(quad.size() == MAZE_CORNERS && isContourConvex(quad) && min(bounds.width, bounds.height) >= MIN_MAZE_SIDE)
+			quads.push_back(quad);
+	}
+
+	// Assigning each header blob to the nearest maze
+	Mat &labels = buffers.componentLabels, &stats = buffers.componentStats, &centroids = buffers.componentCentroids;
+	const int labelsCount = connectedComponentsWithStats(header, labels, stats, centroids, 8, CV_32S);
+	vector<int> owners((size_t)labelsCount, -1);
+	for(int label = 1; label < labelsCount; ++label) {
+		const Point2f centroid((float)centroids.at<double>(label, 0), (float)centroids.at<double>(label, 1));
+		double nearestDist = numeric_limits<double>::max();
+		for(int idx = 0, lim = (int)quads.size(); idx < lim; ++idx) {
+			const double dist = -pointPolygonTest(quads[(size_t)idx], centroid, true); // positive outside the maze
+			const Rect bounds = boundingRect(quads[(size_t)idx]);
+			if(dist < nearestDist && dist * 100. <= MAX_HEADER_DISTANCE_PERCENT * max(bounds.width, bounds.height)) {
+				nearestDist = dist;
+				owners[(size_t)label] = idx;
+			}
+		}
+	}
+
+	vector<vector<Point>> headersPixels(quads.size());
+	for(int r = 0; r < labels.rows; ++r) {
+		const int *labelsRow = labels.ptr<int>(r);
+		for(int c = 0; c < labels.cols; ++c) {
+			const int owner = owners[(size_t)labelsRow[c]];
+			if(owner >= 0)
+				headersPixels[(size_t)owner].emplace_back(c, r);
+		}
+	}
+
+	// The locations of the mazes with headers, for bgrImg
+	const double scale = (double)(1 << pyramidLevels);
+	vector<MazeLocation> locations;
+	for(size_t idx = 0ULL; idx < quads.size(); ++idx) {
+		if(headersPixels[idx].empty())
+			continue;
+
+		MazeLocation location;
+		for(const auto &corner : quads[idx])
+			location.coarseCorners.push_back(Point2d(corner) * scale);
+		location.headerCenter = Point2d(minAreaRect(headersPixels[idx]).center) * scale;
+		if(pyramidLevels > 0)
+			location.cornersPrecision = 2. * scale + 2.;
+		locations.push_back(location);
+	}
 
-	approxPolyDP(contours[0], mazeCorners, arcLength(contours[0], true) * .02, true);
+	// Ordering the mazes by rows, then by columns. A row contains the mazes whose tops are closer than half a maze side
+	const auto topOf = [] (const MazeLocation &location) {
+		double top = numeric_limits<double>::max();
+		for(const auto &corner : location.coarseCorners)
+			top = min(top, corner.y);
+		return top;
+	};
+	const auto leftOf = [] (const MazeLocation &location) {
+		double left = numeric_limits<double>::max();
+		for(const auto &corner : location.coarseCorners)
+			left = min(left, corner.x);
+		return left;
+	};
+	sort(BOUNDS_OF(locations), [&] (const MazeLocation &a, const MazeLocation &b) { return topOf(a) < topOf(b); });
+	for(auto itRow = locations.begin(); itRow != locations.end();) {
+		const double rowTop = topOf(*itRow), halfSide = norm(itRow->coarseCorners[0] - itRow->coarseCorners[1]) / 2.;
+		auto itRowEnd = itRow;
+		while(itRowEnd != locations.end() && topOf(*itRowEnd) - rowTop < halfSide)
+			++itRowEnd;
+		sort(itRow, itRowEnd, [&] (const MazeLocation &a, const MazeLocation &b) { return leftOf(a) < leftOf(b); });
+		itRow = itRowEnd;
+	}
+
+	return locations;
+}
+
+void ImageMazeParser::detectMazeCorners(const vector<Point> &mazeContour, vector<Point> &mazeCorners) {
+	approxPolyDP(mazeContour, mazeCorners, arcLength(mazeContour, true) * .02, true);
 	if(mazeCorners.size() != MAZE_CORNERS) // There should be only 4 corners for the maze, since it's a quadrilateral!
 		throw domain_error("Wrongfully isolated a non-quadrilateral shape, while looking for the maze!");
 }
 
+double ImageMazeParser::refineMazeCorners(const vector<Point2d> &coarseCorners, double bandHalfWidth,
+										   vector<Point2d> &mazeCorners) const {
+	enum { MIN_EDGE_POINTS = EDGE_SAMPLES_PER_SIDE / 2 };
+	const double sideMargin = .1; // the probes avoid the corners, where the 2 sides interfere
+	const double darkThreshold = buffers.thresholds.mazeMaxBlack;
+
+	Point2d mazeCenter;
+	for(const auto &corner : coarseCorners)
+		mazeCenter += corner * (1. / MAZE_CORNERS);
+
+	size_t weakestSideEdgePoints = EDGE_SAMPLES_PER_SIDE;
+
+	// each side is described by 2 of its points, which are the coarse corners when the refinement fails
+	vector<pair<Point2d, Point2d>> sides(MAZE_CORNERS);
+	vector<Point2f> edgePoints;
+	for(size_t i = 0ULL; i<MAZE_CORNERS; ++i) {
+		const Point2d &from = coarseCorners[i], &to = coarseCorners[(i + 1ULL) % MAZE_CORNERS];
+		sides[i] = make_pair(from, to);
+
+		const Point2d along = to - from;
+		Point2d outwards(along.y, -along.x);
+		outwards *= 1. / norm(outwards);
+		if((segCenter(from, to) - mazeCenter).ddot(outwards) < 0.)
+			outwards *= -1.;
+
+		// Probing from outside inwards, looking for the first dark pixel; the edge is where the brightness crosses the threshold
+		edgePoints.clear();
+		for(int sample = 0; sample < EDGE_SAMPLES_PER_SIDE; ++sample) {
+			const Point2d sidePoint = from + along * (sideMargin + (1. - 2. * sideMargin) * sample / (EDGE_SAMPLES_PER_SIDE - 1));
+			double prevOffset = bandHalfWidth, prevBrightness = brightnessAt(originalImg, sidePoint + outwards * prevOffset);
+			for(double offset = bandHalfWidth - 1.; offset >= -bandHalfWidth; offset -= 1.) {
+				const double brightness = brightnessAt(originalImg, sidePoint + outwards * offset);
+				if(brightness >= 0. && brightness < darkThreshold) {
+					if(prevBrightness >= darkThreshold) // a light pixel was found before this dark one
+						edgePoints.push_back(sidePoint + outwards *
+							(prevOffset - (prevBrightness - darkThreshold) / (prevBrightness - brightness)));
+					break;
+				}
+				prevOffset = offset; prevBrightness = brightness;
+			}
+		}
+
+		weakestSideEdgePoints = min(weakestSideEdgePoints, edgePoints.size());
+		if(edgePoints.size() >= (size_t)MIN_EDGE_POINTS) {
+			Vec4f fittedLine; // direction followed by a point of the line
+			fitLine(edgePoints, fittedLine, DIST_HUBER, 0., .01, .01);
+			const Point2d linePoint(fittedLine[2], fittedLine[3]);
+			sides[i] = make_pair(linePoint, linePoint + Point2d(fittedLine[0], fittedLine[1]));
+		}
+	}
+
+	// corner i is shared by the sides (i-1) and i
+	mazeCorners.resize(MAZE_CORNERS);
+	for(size_t i = 0ULL; i<MAZE_CORNERS; ++i) {
+		const auto &prevSide = sides[(i + MAZE_CORNERS - 1ULL) % MAZE_CORNERS], &side = sides[i];
+		if(false == linesIntersection(prevSide.first, prevSide.second, side.first, side.second, mazeCorners[i]))
+			mazeCorners[i] = coarseCorners[i];
+	}
+
+	return (double)weakestSideEdgePoints / EDGE_SAMPLES_PER_SIDE;
+}
+
+bool ImageMazeParser::trackCorners() {
+	vector<Point2f> &trackedCorners = buffers.trackedCorners;
+	vector<Point2d> previousCorners, mazeCorners;
+	for(const auto &corner : trackedCorners)
+		previousCorners.emplace_back(corner.x, corner.y);
+
+	if(refineMazeCorners(previousCorners, TRACKING_BAND_HALF_WIDTH, mazeCorners) * 100. < MIN_TRACKING_CONFIDENCE_PERCENT) {
+		if(verbose)
+			cout<<"Lost track of the maze. Detecting it again ..."<<endl;
+		return false;
+	}
+
+	for(int i = 0; i<MAZE_CORNERS; ++i)
+		trackedCorners[(size_t)i] = Point2f((float)mazeCorners[(size_t)i].x, (float)mazeCorners[(size_t)i].y);
+
+	rectifyMaze(trackedCorners);
+	return true;
+}
+
+void ImageMazeParser::chooseStraightSide(const vector<Point2f> &orderedCorners) {
+	straightSide = MAZE_SIDE_DEF_SIZE;
+	estimatedCells = 0;
+	cellScale = 1.;
+
+	// About one sample per original pixel along the longest side of the maze
+	double longestSide = 0.;
+	for(int i = 0; i<MAZE_CORNERS; ++i)
+		longestSide = max(longestSide, norm(orderedCorners[(size_t)i] - orderedCorners[size_t((i+1) % MAZE_CORNERS)]));
+	const int probeSide = min(max((int)longestSide, (int)MIN_GRID_PROBE_SIDE), (int)MAX_GRID_PROBE_SIDE);
+
+	// The positions of the samples within a probeSide x probeSide straightened maze, mapped back to originalImg
+	vector<Point2f> samples;
+	samples.reserve(size_t(2 * GRID_PROBE_LINES * probeSide));
+	for(int probe = 0; probe < GRID_PROBE_LINES; ++probe) {
+		const float across = (probe + .5f) * probeSide / GRID_PROBE_LINES;
+		for(int i = 0; i < probeSide; ++i)
+			samples.emplace_back((float)i, across); // crossing the vertical walls
+		for(int i = 0; i < probeSide; ++i)
+			samples.emplace_back(across, (float)i); // crossing the horizontal walls
+	}
+	perspectiveTransform(samples, samples, getPerspectiveTransform(idealCorners(probeSide), orderedCorners));
+
+	// Projections of the darkness of the samples
+	vector<double> vProfile((size_t)probeSide, 0.), hProfile((size_t)probeSide, 0.);
+	auto itSample = samples.cbegin();
+	for(int probe = 0; probe < GRID_PROBE_LINES; ++probe) {
+		for(auto *profile : { &vProfile, &hProfile })
+			for(int i = 0; i < probeSide; ++i, ++itSample) {
+				const double brightness = brightnessAt(originalImg, Point2d(*itSample));
+				if(brightness >= 0.)
+					(*profile)[(size_t)i] += 255. - brightness;
+			}
+	}
+
+	// Mazes with more than twice the cells fitting MAX_STRAIGHT_SIDE are straightened at MAX_STRAIGHT_SIDE anyway
+	const int minPeriod = max(2, probeSide * TARGET_CELL_SIDE / (2 * MAX_STRAIGHT_SIDE));
+	const double period = estimateGridPeriod(vProfile, hProfile, minPeriod);
+	if(period <= 0.) {
+		if(verbose)
+			cout<<"Couldn't estimate the cells count. Using the default straightened side "<<straightSide<<endl;
+		return;
+	}
+
+	estimatedCells = max(1, (int)(probeSide / period + .5));
+	straightSide = min(max(estimatedCells * TARGET_CELL_SIDE, (int)MIN_STRAIGHT_SIDE), (int)MAX_STRAIGHT_SIDE);
+	cellScale = (double)straightSide / (estimatedCells * TARGET_CELL_SIDE);
+
+	if(verbose) {
+		PRINTLN(estimatedCells);
+		PRINTLN(straightSide);
+	}
+}
+
+void ImageMazeParser::rectifyMaze(const vector<Point2f> &orderedCorners) {
+	chooseStraightSide(orderedCorners);
+
+	// Knowing the cells count, the later stages need just a few lines and the cell centers, which get sampled directly from originalImg
+	if(estimatedCells > 0 && false == buffers.denseSampling) {
+		straightToOriginal = getPerspectiveTransform(idealCorners(straightSide), orderedCorners);
+		return;
+	}
+	straightToOriginal.release();
+
+	// Unrotated and unmirrored mazes (like most screenshots) just get cropped and scaled
+	const Size straightSize(straightSide, straightSide);
+	Rect alignedMaze;
+	if(axisAligned(orderedCorners, originalImg.size(), alignedMaze)) {
+		if(verbose)
+			cout<<"The maze is axis-aligned. Cropping and resizing it instead of warping it"<<endl;
+
+		if(alignedMaze.size() == straightSize)
+			originalImg(alignedMaze).copyTo(straightImg); // no resampling needed
+		else
+			resize(originalImg(alignedMaze), straightImg, straightSize, 0., 0., INTER_LINEAR);
+		return;
+	}
+
+	warpPerspective(originalImg, straightImg, getPerspectiveTransform(orderedCorners, idealCorners(straightSide)),
+					straightSize);
+}
+
+bool ImageMazeParser::axisAligned(const vector<Point2f> &orderedCorners, const Size &imgSize, Rect &alignedMaze) {
+	const Point2f &topRight = orderedCorners[0], &topLeft = orderedCorners[1],
+		&bottomLeft = orderedCorners[2], &bottomRight = orderedCorners[3];
+	if(topRight.x <= topLeft.x || bottomLeft.y <= topLeft.y)
+		return false; // rotated or mirrored
+
+	const float tolerance = max(1.f, (topRight.x - topLeft.x) * AXIS_ALIGNMENT_TOLERANCE_PERMILLE / 1000.f);
+	if(abs(topLeft.y - topRight.y) > tolerance || abs(bottomLeft.y - bottomRight.y) > tolerance ||
+			abs(topLeft.x - bottomLeft.x) > tolerance || abs(topRight.x - bottomRight.x) > tolerance)
+		return false; // rotated or in perspective
+
+	const int left = cvRound((topLeft.x + bottomLeft.x) / 2.f), right = cvRound((topRight.x + bottomRight.x) / 2.f),
+		top = cvRound((topLeft.y + topRight.y) / 2.f), bottom = cvRound((bottomLeft.y + bottomRight.y) / 2.f);
+	alignedMaze = Rect(left, top, right - left + 1, bottom - top + 1) & Rect(Point(), imgSize); // the corners are the centers of the extreme pixels
+	return alignedMaze.width > 1 && alignedMaze.height > 1;
+}
+
 void ImageMazeParser::straightenMaze() {
+	vector<Point2f> &trackedCorners = buffers.trackedCorners;
+	if(buffers.trackMaze && trackedCorners.size() == MAZE_CORNERS && trackCorners())
+		return;
+
+	trackedCorners.clear(); // a failed detection mustn't leave behind the corners of a previous image
+
+	// Rejecting early the images which don't look like a maze
+	const double confidence = prescreen(originalImg, buffers);
+	if(verbose)
+		PRINTLN(confidence);
+	if(confidence * 100. < MIN_PRESCREEN_CONFIDENCE_PERCENT)
+		throw domain_error("The image doesn't seem to contain a maze (too few of its expected features were found on the thumbnail)!");
+
+	int pyramidLevels = 0;
 	Point2d headerCenter;
-	Mat img = preprocessImg(headerCenter);
+	const vector<Point> mazeContour = preprocessImg(pyramidReduced(originalImg, buffers, pyramidLevels), headerCenter);
 // 	circle(colorImg, headerCenter, 1, Scalar(0U, 0U, 255U), 1, 8, 0); // red dot marking the center of the header
 
-	vector<Point> mazeCorners;
-	vector<Point2d> sidesCenters(MAZE_CORNERS);
-	detectMazeCorners(img, mazeCorners);
+	vector<Point> coarseMazeCorners;
+	detectMazeCorners(mazeContour, coarseMazeCorners);
+
+	const double scale = (double)(1 << pyramidLevels);
+	MazeLocation location;
+	for(const auto &corner : coarseMazeCorners)
+		location.coarseCorners.push_back(Point2d(corner) * scale);
+	location.headerCenter = headerCenter * scale;
+	if(pyramidLevels > 0)
+		location.cornersPrecision = 2. * scale + 2.; // the band covers the imprecision of the coarse detection
+
+	straightenLocatedMaze(location);
+}
+
+const Mat& ImageMazeParser::pyramidReduced(const Mat &bgrImg, ImageParsingBuffers &buffers, int &pyramidLevels) {
+	pyramidLevels = 0;
+	for(int largerSide = max(bgrImg.rows, bgrImg.cols); largerSide > PYRAMID_MAX_SIDE; largerSide /= 2)
+		++pyramidLevels;
+
+	Mat &reducedImg = buffers.reducedImg;
+	for(int level = 0; level < pyramidLevels; ++level)
+		pyrDown((level == 0) ? bgrImg : reducedImg, reducedImg);
+
+	return (pyramidLevels == 0) ? bgrImg : reducedImg;
+}
+
+void ImageMazeParser::straightenLocatedMaze(const MazeLocation &location) {
+	vector<Point2f> &trackedCorners = buffers.trackedCorners;
+	const Point2d &headerCenter = location.headerCenter;
+	vector<Point2d> mazeCorners, sidesCenters(MAZE_CORNERS);
+	if(location.cornersPrecision > 0.)
+		refineMazeCorners(location.coarseCorners, location.cornersPrecision, mazeCorners);
+	else
+		mazeCorners = location.coarseCorners;
 
 	// We have the header's center and we need to know what's the nearest side of the maze, to establish maze's top
 	// We just compute the L1 distance between header's center and each side's center and find the minimum
@@ -272,23 +1063,18 @@ void ImageMazeParser::straightenMaze() {
 // 	circle(colorImg, headerCenterProjection, 1, Scalar(255U, 0U, 0U), 2, 8, 0);
 
 	// checking where the intersection happens to be and if needed, demanding a flip
-	if(norm(Point2d(mazeCorners[(size_t)idxNearestMazeSide]) - headerCenterProjection) <
-				norm(headerCenterProjection - Point2d(mazeCorners[size_t((idxNearestMazeSide + 1) % MAZE_CORNERS)])))
+	if(norm(mazeCorners[(size_t)idxNearestMazeSide] - headerCenterProjection) <
+				norm(headerCenterProjection - mazeCorners[size_t((idxNearestMazeSide + 1) % MAZE_CORNERS)]))
 	   flipRequired = true;
 
 	// mapping the corners to their appropriate position, by expressing which index will be each corner
-	vector<Point2f> quadPts(MAZE_CORNERS), mazeCornersFp(MAZE_CORNERS);
-	for(int i = 0; i<MAZE_CORNERS; ++i) {
-		int idx = perspectiveCornerIdxMapping(i, idxNearestMazeSide, flipRequired);
-		quadPts[(size_t)i] = cornersIdxMap[idx];
-		mazeCornersFp[(size_t)i] = mazeCorners[(size_t)i];
-	}
-
-	// Get transformation matrix
-	Mat transformM = getPerspectiveTransform(mazeCornersFp, quadPts);
+	// (the corners are kept in this order also for tracking them in the next frame)
+	trackedCorners.resize(MAZE_CORNERS);
+	for(int i = 0; i<MAZE_CORNERS; ++i)
+		trackedCorners[(size_t)perspectiveCornerIdxMapping(i, idxNearestMazeSide, flipRequired)] =
+			Point2f((float)mazeCorners[(size_t)i].x, (float)mazeCorners[(size_t)i].y);
 
-	// Apply perspective transformation
-	warpPerspective(originalImg, straightImg, transformM, Size(MAZE_SIDE_DEF_SIZE, MAZE_SIDE_DEF_SIZE));
+	rectifyMaze(trackedCorners);
 }
 
 double ImageMazeParser::nthIdealWallCoord(int x0, double delta, int idx) {
@@ -299,16 +1085,193 @@ int ImageMazeParser::indexOfWallWithCoord(int x0, double delta, int wallCoord) {
 	return (int)(floor((wallCoord - x0) / delta + .5));
 }
 
-size_t ImageMazeParser::find1stFeasibleMazeSize(vector<int> &hWallsCoords, double &deltaH, vector<int> &vWallsCoords, double &deltaV) {
-	enum { MAX_DIFF_BETWEEN_MAZE_SIDES = 10, ERROR_MULTIPLIER_THRESHOLD = 10 }; // adjusted to suit the provided mazes
-	size_t n = max(vWallsCoords.size(), hWallsCoords.size()) - 1U; // n >= maximum from the sizes of the 2 vectors of coordinates - 1
+void ImageMazeParser::wallsProjections(const Mat &walls, vector<double> &vProfile, vector<double> &hProfile) {
+	vector<int> &columnSums = buffers.wallsColumnSums, &rowSums = buffers.wallsRowSums;
+	columnSums.assign((size_t)walls.cols, 0);
+	rowSums.assign((size_t)walls.rows, 0);
+
+	// Each row tile accumulates its own column sums, which are added afterwards in tile order
+	Mat &tilesColumnSums = buffers.tilesColumnSums;
+	tilesColumnSums.create(tilesCount(walls.rows, ROWS_PER_TILE), walls.cols, CV_32SC1);
+	forEachRowTile(walls.rows, [&] (int tile, int fromRow, int toRow) {
+		int *tileColumnSums = tilesColumnSums.ptr<int>(tile);
+		fill_n(tileColumnSums, walls.cols, 0);
+		for(int r = fromRow; r < toRow; ++r) {
+			const UINT8 *row = walls.ptr<UINT8>(r);
+			int rowSum = 0;
+			for(int c = 0; c < walls.cols; ++c) {
+				const int wallPixel = (row[c] != 0U) ? 1 : 0;
+				tileColumnSums[c] += wallPixel;
+				rowSum += wallPixel;
+			}
+			rowSums[(size_t)r] = rowSum;
+		}
+	});
+
+	for(int tile = 0; tile < tilesColumnSums.rows; ++tile) {
+		const int *tileColumnSums = tilesColumnSums.ptr<int>(tile);
+		for(int c = 0; c < walls.cols; ++c)
+			columnSums[(size_t)c] += tileColumnSums[c];
+	}
+	const int total = accumulate(CONST_BOUNDS_OF(rowSums), 0);
+
+	if(total == 0)
+		throw domain_error("No walls were found within the maze! Please check the thresholds if the image is correct!");
+
+	// Each wall pixel weighs 1/total, like in the integral image used previously
+	const double pixelWeight = 1. / total;
+	vProfile.resize(columnSums.size());
+	hProfile.resize(rowSums.size());
+	transform(CONST_BOUNDS_OF(columnSums), vProfile.begin(), [pixelWeight] (int sum) { return sum * pixelWeight; });
+	transform(CONST_BOUNDS_OF(rowSums), hProfile.begin(), [pixelWeight] (int sum) { return sum * pixelWeight; });
+}
+
+void ImageMazeParser::sampleLines(const vector<int> &coords, bool alongRows) {
+	const int linesCount = (int)coords.size();
+	Mat &mapX = buffers.sampleMapX, &mapY = buffers.sampleMapY;
+	mapX.create(linesCount, straightSide, CV_32FC1);
+	mapY.create(linesCount, straightSide, CV_32FC1);
+
+	const double *h = straightToOriginal.ptr<double>(); // the homography, row by row
+	for(int line = 0; line < linesCount; ++line) {
+		float *xs = mapX.ptr<float>(line), *ys = mapY.ptr<float>(line);
+		for(int i = 0; i < straightSide; ++i) {
+			const double x = alongRows ? i : coords[(size_t)line], y = alongRows ? coords[(size_t)line] : i,
+				w = h[6] * x + h[7] * y + h[8];
+			xs[i] = (float)((h[0] * x + h[1] * y + h[2]) / w);
+			ys[i] = (float)((h[3] * x + h[4] * y + h[5]) / w);
+		}
+	}
+
+	remap(originalImg, buffers.sampledPixels, mapX, mapY, INTER_LINEAR);
+}
+
+void ImageMazeParser::sampledWallsProjections(vector<double> &vProfile, vector<double> &hProfile) {
+	const int linesCount = SAMPLED_LINES_PER_CELL * estimatedCells;
+	vector<int> coords((size_t)linesCount);
+	for(int line = 0; line < linesCount; ++line)
+		coords[(size_t)line] = (int)((line + .5) * straightSide / linesCount);
+
+	const double maxCrossingRun = straightSide / (2. * estimatedCells); // longer dark runs are walls along the sampled line
+	vector<int> &sums = buffers.wallsColumnSums;
+	Mat &walls = buffers.sampledWalls;
+	for(auto *profile : { &vProfile, &hProfile }) {
+		const bool alongRows = (profile == &vProfile); // the rows cross the vertical walls
+		sampleLines(coords, alongRows);
+		classifyPixels(buffers.sampledPixels, buffers.thresholds.wallsMaxBlack, 0U, 0U, &walls);
+
+		sums.assign((size_t)straightSide, 0);
+		for(int line = 0; line < linesCount; ++line) {
+			const UINT8 *pixels = walls.ptr<UINT8>(line);
+			for(int from = 0; from < straightSide;) {
+				if(pixels[from] == 0U) {
+					++from;
+					continue;
+				}
+
+				int to = from + 1;
+				while(to < straightSide && pixels[to] != 0U)
+					++to;
+				if(to - from <= maxCrossingRun)
+					for(int i = from; i < to; ++i)
+						++sums[(size_t)i];
+				from = to;
+			}
+		}
+
+		const int total = accumulate(CONST_BOUNDS_OF(sums), 0);
+		if(total == 0)
+			throw domain_error("No walls were found within the maze! Please check the thresholds if the image is correct!");
+
+		const double pixelWeight = 1. / total;
+		profile->resize(sums.size());
+		transform(CONST_BOUNDS_OF(sums), profile->begin(), [pixelWeight] (int sum) { return sum * pixelWeight; });
+	}
+}
+
+void ImageMazeParser::sampleProbedLines(const vector<int> &centers, bool alongRows) {
+	enum { BAND_LINES = 3 }; // each center and its 2 neighbor lines, needed by the dilation
+	const int lim = (int)centers.size();
+	vector<int> coords;
+	coords.reserve(size_t(BAND_LINES * lim));
+	for(const int center : centers)
+		for(int offset = -BAND_LINES / 2; offset <= BAND_LINES / 2; ++offset)
+			coords.push_back(min(max(center + offset, 0), straightSide - 1));
+
+	sampleLines(coords, alongRows);
+	Mat &walls = buffers.sampledWalls;
+	classifyPixels(buffers.sampledPixels, buffers.thresholds.wallsMaxBlack, 0U, 0U, &walls);
+	dilate(walls, walls, structuralElem); // the middle line of each band isn't affected by the neighbor bands
+
+	Mat &probedLines = buffers.probedLines;
+	probedLines.create(lim, straightSide, CV_8UC1);
+	for(int i = 0; i < lim; ++i)
+		walls.row(BAND_LINES * i + BAND_LINES / 2).copyTo(probedLines.row(i));
+}
+
+double ImageMazeParser::estimateGridPeriod(vector<double> &vProfile, vector<double> &hProfile, int minPeriod) {
+	const int maxPeriod = (int)min(vProfile.size(), hProfile.size()) / 2; // the borders alone correlate at about the whole length
+	if(minPeriod < 1 || maxPeriod - minPeriod < 2)
+		return 0.;
+
+	// The autocorrelations of both projections (without their mean), each normalized by its value for lag 0, are summed
+	vector<double> correlations((size_t)maxPeriod + 2ULL, 0.);
+	for(auto *profile : { &vProfile, &hProfile }) {
+		const double mean = accumulate(CONST_BOUNDS_OF(*profile), 0.) / profile->size();
+		for(auto &val : *profile)
+			val -= mean;
+
+		const int len = (int)profile->size();
+		const double *p = profile->data();
+		const double energy = inner_product(p, p + len, p, 0.);
+		if(energy <= 0.)
+			return 0.;
+
+		for(int lag = minPeriod - 1; lag <= maxPeriod + 1; ++lag)
+			correlations[(size_t)lag] += inner_product(p, p + len - lag, p + lag, 0.) / energy;
+	}
+
+	// Skipping the central lobe (each wall correlating with itself), up to the first lag without a positive correlation
+	int firstLag = minPeriod;
+	while(firstLag <= maxPeriod && correlations[(size_t)firstLag] > 0.)
+		++firstLag;
+	if(firstLag > maxPeriod)
+		return 0.;
+
+	const double strongest = *max_element(correlations.cbegin() + firstLag, correlations.cbegin() + maxPeriod + 1);
+	if(strongest <= 0.)
+		return 0.;
+
+	// The smallest significant peak is the period; its multiples produce peaks, too
+	for(int lag = firstLag; lag <= maxPeriod; ++lag) {
+		const double prev = correlations[(size_t)lag - 1ULL], crt = correlations[(size_t)lag], next = correlations[(size_t)lag + 1ULL];
+		if(crt < .5 * strongest || crt < prev || crt < next)
+			continue;
+
+		// parabolic interpolation of the peak
+		const double curvature = prev - 2. * crt + next;
+		return (curvature < 0.) ? (lag + .5 * (prev - next) / curvature) : (double)lag;
+	}
+
+	return 0.;
+}
+
+size_t ImageMazeParser::find1stFeasibleMazeSize(vector<int> &hWallsCoords, double &deltaH, vector<int> &vWallsCoords, double &deltaV,
+												double estimatedPeriod/* = 0.*/) {
+	enum { MAX_DIFF_BETWEEN_MAZE_SIDES = 10, ERROR_MULTIPLIER_THRESHOLD = 10 }; // adjusted to suit the provided mazes, for the default straightened side / cell side
+	const double maxDiffBetweenMazeSides = MAX_DIFF_BETWEEN_MAZE_SIDES * (double)straightSide / MAZE_SIDE_DEF_SIZE,
+		errorMultiplierThreshold = ERROR_MULTIPLIER_THRESHOLD * cellScale;
+	if(vWallsCoords.size() < 2U || hWallsCoords.size() < 2U)
+		throw domain_error("Couldn't find both borders of the maze on each axis! Please check the thresholds if the image is correct!");
+
+	const size_t minN = max(vWallsCoords.size(), hWallsCoords.size()) - 1U; // n >= maximum from the sizes of the 2 vectors of coordinates - 1
 
 	int idx, v0 = vWallsCoords.front(), h0 = hWallsCoords.front();
-	if(abs(vWallsCoords.back() - v0 - hWallsCoords.back() + h0) > MAX_DIFF_BETWEEN_MAZE_SIDES)
+	if(abs(vWallsCoords.back() - v0 - hWallsCoords.back() + h0) > maxDiffBetweenMazeSides)
 		throw domain_error("Maze borders don't seem to be of a square maze! Please check interpolation and thresholding if the image is correct!");
 
-	// Increasing n until the real segments are close enough to the ideal ones for the checked n
-	for(;; ++n) {
+	// Checks if the real segments are close enough to the ideal ones for the given n
+	const auto feasible = [&] (size_t n) {
 		double error = 0;
 		deltaV = (vWallsCoords.back() - v0 + 1.) / n;
 		deltaH = (hWallsCoords.back() - h0 + 1.) / n;
@@ -323,15 +1286,42 @@ size_t ImageMazeParser::find1stFeasibleMazeSize(vector<int> &hWallsCoords, doubl
 			error += abs(nthIdealWallCoord(h0, deltaH, idx) - coord);
 		}
 
-		if(error < ERROR_MULTIPLIER_THRESHOLD * n)
-			break;
+		if(error < errorMultiplierThreshold * n)
+			return true;
 
 		if(verbose) {
 			cout<<"Checked "<<n<<endl;
 			PRINTLN(error);
 		}
+		return false;
+	};
+
+	size_t n = 0U;
+
+	if(estimatedPeriod > 0.) {
+		// The estimation might be off by one for fine grids, while its divisors cover a period that was detected twice too large
+		const double span = ((vWallsCoords.back() - v0) + (hWallsCoords.back() - h0) + 2.) / 2.;
+		const size_t estimatedN = (size_t)(span / estimatedPeriod + .5);
+		set<size_t> candidates { estimatedN, estimatedN + 1U };
+		if(estimatedN > 1U)
+			candidates.insert(estimatedN - 1U);
+		for(size_t divisor = 2U; estimatedN / divisor >= max(minN, (size_t)1U); ++divisor)
+			candidates.insert(estimatedN / divisor);
+
+		// The smallest feasible candidate wins. A smaller n outside the candidates might be feasible, too,
+		// but it would contradict the detected period, so it's considered only when no candidate fits
+
+		for(size_t candidate : candidates)
+			if(candidate >= minN && candidate > 0U && feasible(candidate)) {
+				n = candidate;
+				break;
+			}
 	}
 
+	// Increasing n until the real segments are close enough to the ideal ones for the checked n
+	if(n == 0U)
+		for(n = minN; false == feasible(n); ++n);
+
 	if(verbose) {
 		cout<<"vWallsIndexes: ";
 		for(auto coord : vWallsCoords) {
@@ -349,27 +1339,24 @@ size_t ImageMazeParser::find1stFeasibleMazeSize(vector<int> &hWallsCoords, doubl
 	return n;
 }
 
-void ImageMazeParser::extractWallsCoords(const Mat &wallsIntegral, bool vertNotHoriz, vector<int> &wallsCoords, int &tolerance) {
-	enum { MIN_CELL_SIDE = 20 }; // adjusted to suit the provided mazes
-
-	Mat toProcess = vertNotHoriz ? wallsIntegral : wallsIntegral.t();
-
-	int lastRow = toProcess.rows-1, lastCol = toProcess.cols - 1, lastWall = -MIN_CELL_SIDE;
+void ImageMazeParser::extractWallsCoords(const vector<double> &wallsProfile, int minCellSide, vector<int> &wallsCoords, int &tolerance) {
+	int lastCol = (int)wallsProfile.size(), lastWall = -minCellSide; // traversing the cumulative sums of the profile, which have an extra leading 0
 	int tol = 0; // tolerance for walls ignoring misplaced walls
 
-	double lastVal = 0, newVal, diff, threshold = 1./255; // threshold of a single pixel + or -
+	// The threshold was adjusted for MAZE_SIDE_DEF_SIZE. The wall pixels from a column / row grow with the straightened side,
+	// while their total grows with its square, so the threshold gets scaled by the inverse of the side
+	double diff, threshold = MAZE_SIDE_DEF_SIZE / (255. * lastCol);
 	bool wallMode = false;
 	int wallStart = -1, wallCenter;
 	for(int i = 0; i<=lastCol; ++i) {
-		newVal = toProcess.at<double>(lastRow, i);
-		diff = newVal-lastVal;
+		diff = (i == 0) ? 0. : wallsProfile[size_t(i - 1)]; // the increase of the cumulative sums up to column i
 		if(wallMode) {
 			if(diff < threshold) {
 				wallMode = false;
 				wallCenter = (wallStart + i - 2) >> 1;
 				tol = max(tol, i - 2 - wallCenter);
 
-				if(wallCenter - lastWall < MIN_CELL_SIDE) { // misplaced wall (a bit shifted)
+				if(wallCenter - lastWall < minCellSide) { // misplaced wall (a bit shifted)
 					int avgWallPos = (lastWall + wallCenter) >> 1;
 
 					wallsCoords.back() = avgWallPos; // replace previous wall with one inbetween these 2 'twin' walls
@@ -387,8 +1374,6 @@ void ImageMazeParser::extractWallsCoords(const Mat &wallsIntegral, bool vertNotH
 				wallStart = i-1;
 			}
 		}
-
-		lastVal = newVal;
 	}
 
 	if(wallMode) {
@@ -399,9 +1384,31 @@ void ImageMazeParser::extractWallsCoords(const Mat &wallsIntegral, bool vertNotH
 	tolerance += tol;
 }
 
-void ImageMazeParser::isolateWalls(Mat &thickWalls, bool vertNotHoriz, size_t n, vector<int> &wallsCoords, double delta, int tolerance, vector<int> &idealCentersOfPerpendicularWalls) {
-	Mat walls = vertNotHoriz ? thickWalls : thickWalls.t();
+void ImageMazeParser::isolateWalls(bool vertNotHoriz, size_t n, vector<int> &wallsCoords, double delta, int tolerance, vector<int> &idealCentersOfPerpendicularWalls) {
 	int x0 = wallsCoords[0], lim = (int)n;
+	const bool sparse = false == straightToOriginal.empty(); // the probed lines were sampled into buffers.probedLines
+	const Mat &thickWalls = sparse ? buffers.probedLines : buffers.walls4BetterDetection;
+	const int lineLen = (sparse || vertNotHoriz) ? thickWalls.cols : thickWalls.rows;
+
+	// Prefix sums of the wall pixels along each probed line: rows of thickWalls for vertical walls, columns otherwise
+	// The probed lines are independent, so they're handled in parallel (a few lines per thread)
+	Mat &probeSums = buffers.probeSums;
+	probeSums.create(lim, lineLen + 1, CV_32SC1);
+	forEachRowTile(lim, [&] (int, int fromLine, int toLine) {
+		for(int i = fromLine; i < toLine; ++i) {
+			const int center = idealCentersOfPerpendicularWalls[(size_t)i];
+			int *sums = probeSums.ptr<int>(i);
+			sums[0] = 0;
+			if(sparse || vertNotHoriz) {
+				const UINT8 *pixels = thickWalls.ptr<UINT8>(sparse ? i : center);
+				for(int j = 0; j < lineLen; ++j)
+					sums[j + 1] = sums[j] + (pixels[j] != 0U ? 1 : 0);
+			} else {
+				for(int j = 0; j < lineLen; ++j)
+					sums[j + 1] = sums[j] + (thickWalls.at<UINT8>(j, center) != 0U ? 1 : 0);
+			}
+		}
+	}, PROBED_LINES_PER_TILE);
 
 	if(vertNotHoriz) {
 		rows.reserve(rowsCount);
@@ -422,16 +1429,20 @@ void ImageMazeParser::isolateWalls(Mat &thickWalls, bool vertNotHoriz, size_t n,
 	for(vector<int>::iterator it = ++wallsCoords.begin(), itEnd = --wallsCoords.end(); it != itEnd; ++it) {
 		int coord = *it;
 		int idxWall = indexOfWallWithCoord(x0, delta, coord);
+		const int probeStart = max(coord - tolerance, 0), probeEnd = min(coord + tolerance, lineLen);
 		for(int i = 0; i < lim; ++i) {
 			int center = idealCentersOfPerpendicularWalls[(size_t)i];
+			const int *sums = probeSums.ptr<int>(i);
 
-			if(countNonZero(walls.row(center).colRange(coord-tolerance, coord+tolerance)) > 0) {
+			if(sums[probeEnd] > sums[probeStart]) { // there are wall pixels within [coord-tolerance, coord+tolerance)
 				if(vertNotHoriz) {
 					rows[(size_t)i] += interval<unsigned>::type((unsigned)idxWall, (unsigned)n);
-					line(debugImg, Point(coord - tolerance, center), Point(coord + tolerance, center), 128U);
+					if(verbose)
+						line(debugImg, Point(coord - tolerance, center), Point(coord + tolerance, center), 128U);
 				} else {
 					columns[(size_t)i] += interval<unsigned>::type((unsigned)idxWall, (unsigned)n);
-					line(debugImg, Point(center, coord - tolerance), Point(center, coord + tolerance), 128U);
+					if(verbose)
+						line(debugImg, Point(center, coord - tolerance), Point(center, coord + tolerance), 128U);
 				}
 			}
 		}
@@ -445,16 +1456,61 @@ ImageMazeParser::ImageMazeParser(const string &fileName,
 							   vector<Coord> &targets,
 							   vector<split_interval_set<unsigned>> &rows,
 							   vector<split_interval_set<unsigned>> &columns,
-							   bool Verbose/* = false*/) :
+							   bool Verbose/* = false*/,
+							   ImageParsingBuffers *reusedBuffers/* = nullptr*/) :
 		rowsCount(rowsCount), columnsCount(columnsCount), startLocation(startLocation), targets(targets), rows(rows), columns(columns),
-		verbose(Verbose) {
+		verbose(Verbose),
+		ownBuffers(), buffers((nullptr != reusedBuffers) ? *reusedBuffers : ownBuffers),
+		originalImg(buffers.originalImg), straightImg(buffers.straightImg), debugImg(buffers.debugImg),
+		straightSide(MAZE_SIDE_DEF_SIZE), estimatedCells(0), cellScale(1.) {
+	process(fileName);
+}
 
-	if(cornersIdxMap.empty()) { // making sure a static is initialized
-		cornersIdxMap[0] = Point2f(MAZE_SIDE_DEF_SIZE-1, 0);
-		cornersIdxMap[1] = Point2f(0, 0);
-		cornersIdxMap[2] = Point2f(0, MAZE_SIDE_DEF_SIZE-1);
-		cornersIdxMap[3] = Point2f(MAZE_SIDE_DEF_SIZE-1, MAZE_SIDE_DEF_SIZE-1);
+ImageMazeParser::ImageMazeParser(const Mat &bgrImg,
+								 const MazeLocation &location,
+								 unsigned &rowsCount,
+								 unsigned &columnsCount,
+								 Coord &startLocation,
+								 vector<Coord> &targets,
+								 vector<split_interval_set<unsigned>> &rows,
+								 vector<split_interval_set<unsigned>> &columns,
+								 bool Verbose/* = false*/,
+								 ImageParsingBuffers *reusedBuffers/* = nullptr*/) :
+		rowsCount(rowsCount), columnsCount(columnsCount), startLocation(startLocation), targets(targets), rows(rows), columns(columns),
+		verbose(Verbose),
+		ownBuffers(), buffers((nullptr != reusedBuffers) ? *reusedBuffers : ownBuffers),
+		originalImg(buffers.originalImg), straightImg(buffers.straightImg), debugImg(buffers.debugImg),
+		straightSide(MAZE_SIDE_DEF_SIZE), estimatedCells(0), cellScale(1.) {
+	originalImg = bgrImg; // no copy
+	try {
+		process(location);
+	} catch(...) {
+		originalImg.release(); // later decodes into the buffers mustn't overwrite the caller's image
+		throw;
 	}
+	originalImg.release();
+}
 
-	process(fileName);
+ImageMazeParser::ImageMazeParser(const Mat &bgrImg,
+								 unsigned &rowsCount,
+								 unsigned &columnsCount,
+								 Coord &startLocation,
+								 vector<Coord> &targets,
+								 vector<split_interval_set<unsigned>> &rows,
+								 vector<split_interval_set<unsigned>> &columns,
+								 bool Verbose/* = false*/,
+								 ImageParsingBuffers *reusedBuffers/* = nullptr*/) :
+		rowsCount(rowsCount), columnsCount(columnsCount), startLocation(startLocation), targets(targets), rows(rows), columns(columns),
+		verbose(Verbose),
+		ownBuffers(), buffers((nullptr != reusedBuffers) ? *reusedBuffers : ownBuffers),
+		originalImg(buffers.originalImg), straightImg(buffers.straightImg), debugImg(buffers.debugImg),
+		straightSide(MAZE_SIDE_DEF_SIZE), estimatedCells(0), cellScale(1.) {
+	originalImg = bgrImg; // no copy
+	try {
+		process();
+	} catch(...) {
+		originalImg.release(); // later decodes into the buffers mustn't overwrite the caller's image
+		throw;
+	}
+	originalImg.release();
 }
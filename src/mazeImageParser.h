@@ -26,7 +26,9 @@
 
 #pragma warning( push, 0 )
 
-#include <map>
+#include <functional>
+
+#include <tmmintrin.h>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -34,31 +36,158 @@
 
 #pragma warning( pop )
 
-/// Reads the maze from an image file
+/// Thresholds for classifying the pixels of an image maze. The defaults are adjusted to suit the provided mazes
+struct ParsingThresholds {
+	UINT8 mazeMaxBlack;			///< isolating the maze and its header within the original image
+	UINT8 mazeMaxRedBlueDiff;	///< the dark pixels whose red and blue differ at least this much are part of the tokens, not of the maze
+	UINT8 wallsMaxBlack;		///< the walls within the straightened maze
+	UINT8 minTokenIntensity;	///< the start location (red) and the targets (blue) under the cell centers
+
+	ParsingThresholds(UINT8 mazeMaxBlack = 210U, UINT8 mazeMaxRedBlueDiff = 55U,
+					  UINT8 wallsMaxBlack = 80U, UINT8 minTokenIntensity = 110U) :
+		mazeMaxBlack(mazeMaxBlack), mazeMaxRedBlueDiff(mazeMaxRedBlueDiff),
+		wallsMaxBlack(wallsMaxBlack), minTokenIntensity(minTokenIntensity) {}
+};
+
+/// Where a maze was found within an image which might contain several mazes
+struct MazeLocation {
+	std::vector<cv::Point2d> coarseCorners;	///< the corners of the maze, in the order of its contour
+	cv::Point2d headerCenter;				///< the center of the header above the maze
+	double cornersPrecision;				///< how far from the real ones might be the coarse corners (0 when they're exact)
+
+	MazeLocation() : coarseCorners(), headerCenter(), cornersPrecision(0.) {}
+};
+
+/**
+Images and intermediary matrices used while parsing an image maze.
+Keeping them between parses (one instance per thread) avoids reallocating them when the images have similar sizes.
+*/
+struct ImageParsingBuffers {
+	cv::Mat originalImg;			///< the decoded image, reused by the next decode. The images provided by callers are released after parsing
+	cv::Mat straightImg;			///< the whole straightened maze; not computed when sampling sparsely (see denseSampling)
+	cv::Mat debugImg;				///< the walls, the start location and the targets detected in verbose mode
+	cv::Mat reducedImg;				///< downscaled originalImg used to locate large mazes
+	cv::Mat thumbnailDark, thumbnailRed, thumbnailBlue; ///< used by ImageMazeParser::prescreen
+	cv::Mat prescreenDark, prescreenRed, prescreenBlue; ///< the full size masks reduced by ImageMazeParser::prescreen into the thumbnail ones
+	cv::Mat tokensMask;				///< the start locations from an image with several mazes
+	cv::Mat mazeMask, headerMask;	///< the maze(s) and the header(s) isolated by ImageMazeParser::preprocessImg / locateMazes
+	cv::Mat componentLabels, componentStats, componentCentroids; ///< the dark components labeled by ImageMazeParser::preprocessImg / locateMazes
+	cv::Mat contoursMask;			///< copy of mazeMask consumed by findContours within ImageMazeParser::locateMazes
+	cv::Mat wallsGross, walls4BetterDetection, wallsEroded;
+	std::vector<int> wallsColumnSums, wallsRowSums; ///< the wall pixels from each column / row of wallsEroded
+	cv::Mat tilesColumnSums;		///< wallsColumnSums for each row tile of wallsEroded, computed in parallel
+	cv::Mat probeSums;				///< prefix sums of the wall pixels along the lines probed by ImageMazeParser::isolateWalls
+	cv::Mat sampleMapX, sampleMapY;	///< the positions within originalImg of the pixels sampled sparsely
+	cv::Mat sampledPixels, sampledWalls; ///< the lines of the straightened maze sampled sparsely and their dark pixels
+	cv::Mat probedLines;			///< the sparsely sampled lines probed by ImageMazeParser::isolateWalls
+	cv::Mat cellColors;				///< the colors sampled sparsely at the centers of the cells
+
+	/**
+	When set (for the frames of a sequence), the maze corners found in the last image are just tracked in the next one.
+	The full detection runs only for the first image and when the tracking fails.
+	*/
+	bool trackMaze;
+	std::vector<cv::Point2f> trackedCorners; ///< the maze corners from the last image, in the order of their straightened positions
+
+	ParsingThresholds thresholds;	///< the thresholds used by the parses based on these buffers
+
+	/**
+	When set, the parse is checked for consistency: square cells, a single start location and at least one target.
+	Inconsistent parses throw domain_error.
+	*/
+	bool strict;
+
+	/// When provided, it's polled between the parsing stages. The parse is abandoned (throwing runtime_error) as soon as it returns true
+	std::function<bool()> abandoned;
+
+	/**
+	By default, once the cells count is estimated, the maze isn't straightened entirely.
+	Only the lines and the cell centers needed by the later stages are mapped into originalImg and sampled from there.
+	When set, the whole maze gets straightened into straightImg anyway (the tests compare the 2 ways).
+	*/
+	bool denseSampling;
+
+	ImageParsingBuffers() : trackMaze(false), thresholds(), strict(false), denseSampling(false) {}
+};
+
+/**
+Reads the maze from an image file.
+It's thread-safe: the static members are initialized before main and are only read afterwards,
+while concurrent parsers should use different ImageParsingBuffers.
+*/
 class ImageMazeParser {
-	enum { chRed, chGreen, chBlue };
-	enum { MAZE_CORNERS = 4, MAZE_SIDE_DEF_SIZE = 400 };
+	enum { MAZE_CORNERS = 4, MAZE_SIDE_DEF_SIZE = 400 }; ///< MAZE_SIDE_DEF_SIZE is the straightened side when the cells count can't be estimated
+	enum { MIN_CELL_SIDE = 20 }; ///< within the straightened maze; adjusted to suit the provided mazes
+	enum { SAMPLED_LINES_PER_CELL = 2 }; ///< lines sampled across each row / column of cells for the walls projections, when sampling sparsely
+	enum { TARGET_CELL_SIDE = 50, ///< the straightened side is chosen to provide about this many pixels per cell
+		MIN_STRAIGHT_SIDE = 200, MAX_STRAIGHT_SIDE = 2000 }; ///< limits of the straightened side
+	enum { GRID_PROBE_LINES = 16, ///< lines sampled across the maze on each axis for estimating the cells count
+		MIN_GRID_PROBE_SIDE = 64, MAX_GRID_PROBE_SIDE = 2048 }; ///< limits of the samples count on each of these lines
+	enum { PYRAMID_MAX_SIDE = 1024 }; ///< larger images are located on a downscaled copy, then refined
+	enum { MIN_DECODED_MAZE_SHARE_PERCENT = 50, ///< the least share of the smaller image side expected to be covered by the maze
+		MAX_DECODE_REDUCTION = 8 }; ///< the largest reduction supported by the jpeg decoder
+	enum { EDGE_SAMPLES_PER_SIDE = 40 }; ///< probes for refining each side of a maze located on a downscaled copy or in a previous frame
+	enum { PRESCREEN_SIDE = 128, ///< larger side of the thumbnail used for rejecting early the images without a maze
+		MIN_PRESCREEN_CONFIDENCE_PERCENT = 75 }; ///< the images scoring less in prescreen aren't parsed
+	enum { AXIS_ALIGNMENT_TOLERANCE_PERMILLE = 5 }; ///< allowed deviation of the sides of an axis-aligned maze, relative to its width
+	enum { TRACKING_BAND_HALF_WIDTH = 6, ///< how far (in pixels) can a side of the maze move between consecutive frames
+		MIN_TRACKING_CONFIDENCE_PERCENT = 75 }; ///< minimum percentage of successful edge probes on every side for accepting the tracked corners
 
 	static const cv::Mat structuralElem;
-	static std::map<int, cv::Point2f> cornersIdxMap; ///< mapping between indexes of corners and their correct positions
 
-	bool verbose;
+	bool verbose;	///< besides reporting details, it enables drawing the detected items into debugImg
 
 	unsigned &rowsCount, &columnsCount;
 	Coord &startLocation;
 	std::vector<Coord> &targets;
 	std::vector<boost::icl::split_interval_set<unsigned>> &rows, &columns;
 
-	cv::Mat originalImg, straightImg, debugImg;
+	ImageParsingBuffers ownBuffers;	///< used when the caller doesn't provide buffers
+	ImageParsingBuffers &buffers;	///< the buffers used by this parser (ownBuffers or the ones from the caller)
+	cv::Mat &originalImg, &straightImg, &debugImg;
 
-	typedef bool(*PixCondition)(UINT8, UINT8, UINT8, UINT8);
-	static bool redOrBlue(UINT8 red, UINT8 green, UINT8 blue, UINT8 threshold = 128U);
-	static bool justRed(UINT8 red, UINT8 green, UINT8 blue, UINT8 threshold = 128U);
-	static bool justBlue(UINT8 red, UINT8 green, UINT8 blue, UINT8 threshold = 128U);
+	int straightSide;	///< side of straightImg, chosen by chooseStraightSide
+	int estimatedCells;	///< cells count per side estimated by chooseStraightSide or 0 when unknown
+	double cellScale;	///< expected cell side within straightImg divided by TARGET_CELL_SIDE; scales the cell-related pixel constants
+	cv::Mat straightToOriginal;	///< maps the straightened maze into originalImg when sampling sparsely; empty when straightImg was computed
+
+	/**
+	Pixel color conditions, provided both for a single pixel and for 16 pixels at once.
+	The vectorized version returns 0xFF for the pixels satisfying the condition and 0 for the rest.
+	*/
+	struct RedOrBlue {
+		static bool pixel(UINT8 red, UINT8 green, UINT8 blue, UINT8 threshold = 128U);
+		static __m128i pixels(const __m128i &red, const __m128i &green, const __m128i &blue, const __m128i &threshold);
+	};
+	struct JustRed {
+		static bool pixel(UINT8 red, UINT8 green, UINT8 blue, UINT8 threshold = 128U);
+		static __m128i pixels(const __m128i &red, const __m128i &green, const __m128i &blue, const __m128i &threshold);
+	};
+	struct JustBlue {
+		static bool pixel(UINT8 red, UINT8 green, UINT8 blue, UINT8 threshold = 128U);
+		static __m128i pixels(const __m128i &red, const __m128i &green, const __m128i &blue, const __m128i &threshold);
+	};
 
-	/// SamplingStep allows checking only each n-th pixel on both axes
-	static bool findPixel(cv::Mat rgbImg, PixCondition pixCondFun, cv::Point &foundPixel,
+	/**
+	Finds the first pixel from a BGR image satisfying PixCondition (one of the structs above).
+	SamplingStep allows checking only each n-th row. The checked rows are traversed entirely, 16 pixels at a time
+	when the CPU supports SSSE3, stopping at the first match.
+	*/
+	template<class PixCondition>
+	static bool findPixel(const cv::Mat &bgrImg, cv::Point &foundPixel,
 						  int samplingStep = 1, UINT8 threshold = 128U);
+
+	/**
+	Classifies the pixels of a BGR image in a single pass, without splitting its channels.
+	Each provided mask gets 255 for the pixels of its class and 0 for the rest; the nullptr masks aren't computed:
+	- darkMask: max(blue, green, red) < darkThreshold (the walls)
+	- grayishDarkMask: dark and with red and blue differing by less than maxRedBlueDiff (the maze and its header, without the tokens)
+	- redMask / blueMask: JustRed / JustBlue using tokenThreshold (the start location / the targets)
+	*/
+	static void classifyPixels(const cv::Mat &bgrImg,
+							   UINT8 darkThreshold, UINT8 maxRedBlueDiff, UINT8 tokenThreshold,
+							   cv::Mat *darkMask, cv::Mat *grayishDarkMask = nullptr,
+							   cv::Mat *redMask = nullptr, cv::Mat *blueMask = nullptr);
 	static cv::Point2d segCenter(const cv::Point2d &p1, const cv::Point2d &p2);
 	static double nthIdealWallCoord(int x0, double delta, int idx);
 	static int indexOfWallWithCoord(int x0, double delta, int wallCoord);
@@ -76,28 +205,131 @@ class ImageMazeParser {
 	by mapping its corners to their expected position
 	*/
 	static int perspectiveCornerIdxMapping(int idxCorner, int idxNearestSegment, bool flipRequired);
-	static void detectMazeCorners(const cv::Mat &img, std::vector<cv::Point> &mazeCorners);
 
-	/// Parsing the integral image and detecting jumps where the walls should be
-	static void extractWallsCoords(const cv::Mat &wallsIntegral, bool vertNotHoriz,
+	/// The positions of the corners of a straightened maze with the given side, in the order of perspectiveCornerIdxMapping
+	static std::vector<cv::Point2f> idealCorners(int side);
+	static void detectMazeCorners(const std::vector<cv::Point> &mazeContour, std::vector<cv::Point> &mazeCorners);
+
+	/**
+	Refines the approximate corners of a maze (found on a downscaled copy or in a previous frame).
+	Each side gets probed along its normal within originalImg, up to bandHalfWidth pixels away,
+	looking for the subpixel position of the outer edge of the maze.
+	The corners are the intersections of the lines fitted through these edge points.
+	The sides without enough edge points keep their coarse position.
+	Returns the ratio of successful probes for the weakest side.
+	*/
+	double refineMazeCorners(const std::vector<cv::Point2d> &coarseCorners, double bandHalfWidth,
+							 std::vector<cv::Point2d> &mazeCorners) const;
+
+	/**
+	Parsing the walls projection on an axis (normalized to sum up to 1) and detecting jumps where the walls should be.
+	Walls closer than minCellSide are merged. The detection threshold is scaled by the length of the profile.
+	*/
+	static void extractWallsCoords(const std::vector<double> &wallsProfile, int minCellSide,
 								   std::vector<int> &wallsCoords, int &tolerance);
 
 	/**
-	Extract just the dark pixels based on a threshold and negative the whole image, so they become white
-	Fill the interior of the maze and remove the header of the maze
-	Returns the header's center, which is in the original images a bit to the left comparing to the maze's center
+	The projections of the walls on the horizontal (vProfile) and vertical axis (hProfile), each normalized to sum up to 1.
+	The wall pixels are counted per column and per row in a single pass over the walls mask, using integer sums.
+	*/
+	void wallsProjections(const cv::Mat &walls, std::vector<double> &vProfile, std::vector<double> &hProfile);
+
+	/**
+	Samples from originalImg the lines of the straightened maze with the provided coordinates (rows when alongRows, columns otherwise),
+	by mapping them through straightToOriginal. Line i becomes row i of buffers.sampledPixels (straightSide bilinearly interpolated pixels).
+	*/
+	void sampleLines(const std::vector<int> &coords, bool alongRows);
+
+	/**
+	Sparse alternative of wallsProjections, based on SAMPLED_LINES_PER_CELL lines across each row / column of the estimated cells.
+	The dark runs longer than half a cell belong to the walls parallel to the sampled line, so they're ignored.
+	Each profile is normalized to sum up to 1.
+	*/
+	void sampledWallsProjections(std::vector<double> &vProfile, std::vector<double> &hProfile);
+
+	/**
+	Sparse alternative of the walls4BetterDetection lines probed by isolateWalls:
+	the lines through the provided centers (rows when alongRows), dilated like walls4BetterDetection based on their neighbor lines.
+	The line through centers[i] becomes row i of buffers.probedLines.
+	*/
+	void sampleProbedLines(const std::vector<int> &centers, bool alongRows);
+
+	/**
+	Extract just the dark pixels based on a threshold, flood the interior of the maze from a red / blue pixel
+	and label the connected components in a single pass. The maze is the component containing that pixel.
+	The header is anchored by the nearest sufficiently large component outside the maze
+	and contains the components around the maze that aren't much farther from it (specks of noise further away are ignored).
+	Returns the outer contour of the maze and the header's center,
+	which is in the original images a bit to the left comparing to the maze's center
 	The header's center can't be the mass center of the convex hull of the header,
 	as this mass center always gets located near the thicker end of the hull.
 	Sometimes this means also too close to the 'Speaker' from the header, and we don't want that at all.
-	So, minAreaRect's center was used to compute header's center
+	So, minAreaRect's center was used to compute header's center, based on the bounding boxes of the header's components.
+	bgrImg is either originalImg or its downscaled copy.
 	*/
-	cv::Mat preprocessImg(cv::Point2d &headerCenter);
+	std::vector<cv::Point> preprocessImg(const cv::Mat &bgrImg, cv::Point2d &headerCenter);
+
+	/// Large images are analyzed first on a copy downscaled with an image pyramid. Returns either bgrImg or buffers.reducedImg
+	static const cv::Mat& pyramidReduced(const cv::Mat &bgrImg, ImageParsingBuffers &buffers, int &pyramidLevels);
+
 	void straightenMaze();
+
+	/// Refines the corners of a located maze, orients it based on its header and straightens it
+	void straightenLocatedMaze(const MazeLocation &location);
+
+	/// Throws runtime_error when the caller abandoned the parse (see ImageParsingBuffers::abandoned)
+	void checkAbandoned() const;
+
+	/// Tracks the maze corners from the previous frame. Returns false if the tracking isn't confident enough
+	bool trackCorners();
+
+	/**
+	Sets straightSide and cellScale for the maze with the provided corners (in the order of their straightened positions).
+	The cells count is estimated from GRID_PROBE_LINES lines per axis, sampled from originalImg through the homography,
+	with about one sample per original pixel. The straightened side provides then TARGET_CELL_SIDE pixels per cell,
+	within [MIN_STRAIGHT_SIDE, MAX_STRAIGHT_SIDE]. When there's no estimation, the side is MAZE_SIDE_DEF_SIZE.
+	*/
+	void chooseStraightSide(const std::vector<cv::Point2f> &orderedCorners);
+
+	/**
+	Chooses the straightened side based on the corners ordered like in chooseStraightSide.
+	When the cells count was estimated, it just prepares straightToOriginal for sampling sparsely (see ImageParsingBuffers::denseSampling).
+	Otherwise (or for dense sampling) it warps originalImg into straightImg.
+	Axis-aligned mazes (see axisAligned) are just cropped and resized, without a perspective transformation.
+	*/
+	void rectifyMaze(const std::vector<cv::Point2f> &orderedCorners);
+
+	/**
+	Checks if the maze with the provided corners (ordered like in chooseStraightSide) is neither rotated, nor mirrored,
+	nor in perspective, that is its sides are horizontal / vertical within AXIS_ALIGNMENT_TOLERANCE_PERMILLE of its width
+	and its top left corner is the one expected in the straightened maze. Then alignedMaze is the area of the maze within imgSize.
+	*/
+	static bool axisAligned(const std::vector<cv::Point2f> &orderedCorners, const cv::Size &imgSize, cv::Rect &alignedMaze);
+
+	/**
+	Estimates the spacing of the walls grid from the autocorrelation of the walls projections on both axes.
+	The lags within the central lobe of the autocorrelation and those above half the profiles are ignored.
+	Returns the smallest remaining lag (refined to subpixel) whose autocorrelation peak is comparable to the strongest one,
+	or 0 when there's no such peak. The profiles get centered on their mean.
+	*/
+	static double estimateGridPeriod(std::vector<double> &vProfile, std::vector<double> &hProfile, int minPeriod);
+
+	/**
+	Finds the smallest maze size n for which the detected walls fit the ideal n x n grid.
+	The sizes suggested by estimatedPeriod (and their divisors) are verified first.
+	When none fits, or there's no estimation (estimatedPeriod is 0), n is increased one by one from its lower bound.
+	*/
 	size_t find1stFeasibleMazeSize(std::vector<int> &hWallsCoords, double &deltaH,
-								   std::vector<int> &vWallsCoords, double &deltaV);
+								   std::vector<int> &vWallsCoords, double &deltaV,
+								   double estimatedPeriod = 0.);
 
-	/// Checking a small area around the ideal center of each potential wall to see if there's indeed a wall there
-	void isolateWalls(cv::Mat &thickWalls, bool vertNotHoriz, size_t n,
+	/**
+	Checking a small area around the ideal center of each potential wall to see if there's indeed a wall there.
+	The probed lines (crossing the ideal centers of the perpendicular walls) get their prefix sums computed first,
+	so each check needs only 2 lookups. The lines come from walls4BetterDetection or,
+	when sampling sparsely, from buffers.probedLines (see sampleProbedLines).
+	*/
+	void isolateWalls(bool vertNotHoriz, size_t n,
 					  std::vector<int> &wallsCoords, double delta, int tolerance,
 					  std::vector<int> &idealCentersOfPerpendicularWalls);
 
@@ -108,8 +340,45 @@ class ImageMazeParser {
 	The center of this header would be slightly to the left from the center of the maze
 	*/
 	void process(const std::string &fileName);
+	void process(); ///< the part of process(fileName) after loading originalImg
+	void process(const MazeLocation &location); ///< process() for a maze already located within originalImg
+	void parseStraightenedMaze(); ///< the part of process() after straightening the maze
 
 public:
+	/**
+	Cheap estimation (between 0 and 1) of the chance that a BGR image contains a maze.
+	It checks on thumbnail masks with the larger side PRESCREEN_SIDE, in a single classification pass plus a flood fill,
+	the presence of the red start location, of the blue targets, of a dark border around them and of the header outside this border.
+	The masks are reduced from the full size classification, so that thin borders can't fade away within the thumbnail.
+	The result is the ratio of the passed checks. The masks are kept in buffers.
+	*/
+	static double prescreen(const cv::Mat &bgrImg, ImageParsingBuffers &buffers);
+
+	/**
+	Alternative thresholds for the images where the defaults fail (washed out, underexposed or with faded tokens).
+	The defaults come first. Initialized before main, so it's safe to read from several threads.
+	*/
+	static const std::vector<ParsingThresholds> thresholdsPortfolio;
+
+	/**
+	Finds all the mazes from a BGR image, in a single classification pass.
+	Each start location (red) seeds the flooding of the interior of its maze. The floods reaching the margins of the image are ignored.
+	The dark blobs outside the mazes are assigned to the nearest maze, forming its header.
+	The mazes without a quadrilateral contour or without a header are skipped.
+	The locations are expressed for bgrImg and are ordered by rows, then by columns.
+	*/
+	static std::vector<MazeLocation> locateMazes(const cv::Mat &bgrImg, ImageParsingBuffers &buffers);
+
+	/**
+	Decodes an encoded image as BGR, into reusedImg when provided (reusing its allocation when the size matches).
+	Oversized images (with the size known from their header: bmp, jpeg and png) are reduced by the largest power of 2
+	(up to MAX_DECODE_REDUCTION) that keeps at least MIN_CELL_SIDE pixels per cell for the worst expected maze:
+	MAX_STRAIGHT_SIDE / TARGET_CELL_SIDE cells per side, spanning MIN_DECODED_MAZE_SHARE_PERCENT of the smaller image side.
+	The jpeg decoder performs the reduction itself for OpenCV 3.2+. Otherwise the image is resized right after decoding.
+	Returns an empty matrix for invalid content.
+	*/
+	static cv::Mat decode(const ByteSpan &content, cv::Mat *reusedImg = nullptr);
+
 	ImageMazeParser(const std::string &fileName,
 				   unsigned &rowsCount,
 				   unsigned &columnsCount,
@@ -117,7 +386,31 @@ public:
 				   std::vector<Coord> &targets,
 				   std::vector<boost::icl::split_interval_set<unsigned>> &rows,
 				   std::vector<boost::icl::split_interval_set<unsigned>> &columns,
-				   bool verbose = false);
+				   bool verbose = false,
+				   ImageParsingBuffers *reusedBuffers = nullptr);
+
+	/// Parses one of the mazes from bgrImg, already located by locateMazes
+	ImageMazeParser(const cv::Mat &bgrImg,
+				   const MazeLocation &location,
+				   unsigned &rowsCount,
+				   unsigned &columnsCount,
+				   Coord &startLocation,
+				   std::vector<Coord> &targets,
+				   std::vector<boost::icl::split_interval_set<unsigned>> &rows,
+				   std::vector<boost::icl::split_interval_set<unsigned>> &columns,
+				   bool verbose = false,
+				   ImageParsingBuffers *reusedBuffers = nullptr);
+
+	/// Parses an already decoded BGR image, like a frame from a video
+	ImageMazeParser(const cv::Mat &bgrImg,
+				   unsigned &rowsCount,
+				   unsigned &columnsCount,
+				   Coord &startLocation,
+				   std::vector<Coord> &targets,
+				   std::vector<boost::icl::split_interval_set<unsigned>> &rows,
+				   std::vector<boost::icl::split_interval_set<unsigned>> &columns,
+				   bool verbose = false,
+				   ImageParsingBuffers *reusedBuffers = nullptr);
 };
 
 
@@ -0,0 +1,135 @@
+/******************************************************************
+ Project TiltedMaze solves tilted maze problems.
+
+ You might visit http://www.agame.com/game/tilt-maze
+ to try yourself solving such problems (use the arrow keys to move)
+
+ The program is able to load the puzzle from text files, but also
+ from captured snapshots, which contain various imperfections.
+ It is possible to recognize the original maze even when rotating,
+ mirroring the snapshot, or even after applying perspective
+ transformations on it.
+ 
+ Solving the maze is presented as an animation, either on console,
+ or within a normal window.
+
+ The project uses OpenCV and Boost.
+
+ Copyright (c) 2014, 2017 Florin Tulba
+
+*******************************************************************/
+
+#include "mazeInput.h"
+
+#pragma warning( push, 0 )
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#pragma warning( pop )
+
+using namespace std;
+using namespace boost::interprocess;
+
+namespace {
+	const struct { const char *signature; size_t len; } imgSignatures[] = {
+		{ "BM", 2ULL },					// bmp
+		{ "\xFF\xD8\xFF", 3ULL },		// jpeg
+		{ "\x89PNG\r\n\x1A\n", 8ULL },	// png
+		{ "II*\0", 4ULL },				// tiff - little endian
+		{ "MM\0*", 4ULL }				// tiff - big endian
+	};
+
+	inline unsigned bigEndian16(const unsigned char *bytes) { return (bytes[0] << 8) | bytes[1]; }
+	inline unsigned bigEndian32(const unsigned char *bytes) { return (bigEndian16(bytes) << 16) | bigEndian16(bytes + 2); }
+	inline unsigned littleEndian16(const unsigned char *bytes) { return (bytes[1] << 8) | bytes[0]; }
+	inline unsigned littleEndian32(const unsigned char *bytes) { return (littleEndian16(bytes + 2) << 16) | littleEndian16(bytes); }
+}
+
+bool ByteSpan::isEncodedImage() const {
+	for(const auto &sig : imgSignatures)
+		if(size >= sig.len && 0 == memcmp(data, sig.signature, sig.len))
+			return true;
+
+	return false;
+}
+
+bool ByteSpan::isJpeg() const {
+	const auto &sig = imgSignatures[1];
+	return size >= sig.len && 0 == memcmp(data, sig.signature, sig.len);
+}
+
+bool ByteSpan::imageSize(unsigned &width, unsigned &height) const {
+	const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data);
+
+	if(size >= 24ULL && 0 == memcmp(data, imgSignatures[2].signature, imgSignatures[2].len)) {
+		// png: the IHDR chunk comes first
+		width = bigEndian32(bytes + 16);
+		height = bigEndian32(bytes + 20);
+		return true;
+	}
+
+	if(size >= 26ULL && 0 == memcmp(data, imgSignatures[0].signature, imgSignatures[0].len)) {
+		// bmp: the old OS/2 info header has 16 bits dimensions; the height is negative for top-down images
+		if(12U == littleEndian32(bytes + 14)) {
+			width = littleEndian16(bytes + 18);
+			height = littleEndian16(bytes + 20);
+		} else {
+			width = (unsigned)abs((int)littleEndian32(bytes + 18));
+			height = (unsigned)abs((int)littleEndian32(bytes + 22));
+		}
+		return true;
+	}
+
+	if(isJpeg()) {
+		// jpeg: the dimensions are in the first Start Of Frame segment
+		for(size_t pos = 2ULL; pos + 1ULL < size;) {
+			if(bytes[pos] != 0xFFU)
+				return false; // corrupt header
+
+			const unsigned char marker = bytes[pos + 1ULL];
+			if(marker == 0xFFU) { // fill byte
+				++pos;
+				continue;
+			}
+
+			if(marker == 0x01U || (marker >= 0xD0U && marker <= 0xD8U)) { // markers without a segment
+				pos += 2ULL;
+				continue;
+			}
+
+			if(pos + 4ULL > size)
+				return false;
+
+			const bool startOfFrame = marker >= 0xC0U && marker <= 0xCFU &&
+				marker != 0xC4U && marker != 0xC8U && marker != 0xCCU; // DHT, JPG and DAC aren't frames
+			if(startOfFrame) {
+				if(pos + 9ULL > size)
+					return false;
+
+				height = bigEndian16(bytes + pos + 5ULL);
+				width = bigEndian16(bytes + pos + 7ULL);
+				return true;
+			}
+
+			pos += 2ULL + bigEndian16(bytes + pos + 2ULL); // skipping the marker and its segment
+		}
+	}
+
+	return false;
+}
+
+ByteSpanStreamBuf::ByteSpanStreamBuf(const ByteSpan &bytes) {
+	char *first = const_cast<char*>(bytes.data); // the get area is never written
+	setg(first, first, first + bytes.size);
+}
+
+MappedFile::MappedFile(const string &fileName) : _name(fileName) {
+	try {
+		mapping = file_mapping(fileName.c_str(), read_only);
+		region = mapped_region(mapping, read_only);
+	} catch(interprocess_exception &e) {
+		throw std::invalid_argument("Couldn't map the file " + fileName + " : " + e.what());
+	}
+}
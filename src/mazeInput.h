@@ -0,0 +1,78 @@
+/******************************************************************
+ Project TiltedMaze solves tilted maze problems.
+
+ You might visit http://www.agame.com/game/tilt-maze
+ to try yourself solving such problems (use the arrow keys to move)
+
+ The program is able to load the puzzle from text files, but also
+ from captured snapshots, which contain various imperfections.
+ It is possible to recognize the original maze even when rotating,
+ mirroring the snapshot, or even after applying perspective
+ transformations on it.
+ 
+ Solving the maze is presented as an animation, either on console,
+ or within a normal window.
+
+ The project uses OpenCV and Boost.
+
+ Copyright (c) 2014, 2017 Florin Tulba
+
+*******************************************************************/
+
+#ifndef H_MAZE_INPUT
+#define H_MAZE_INPUT
+
+#pragma warning( push, 0 )
+
+#include <string>
+#include <streambuf>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#pragma warning( pop )
+
+/// Read-only view on bytes owned by someone else (a maze already in memory)
+struct ByteSpan {
+	const char *data;
+	size_t size;
+
+	ByteSpan() : data(nullptr), size(0ULL) {}
+	ByteSpan(const void *data, size_t size) : data(static_cast<const char*>(data)), size(size) {}
+
+	/// Checks the signatures of the supported image formats (bmp, jpeg, png, tiff)
+	bool isEncodedImage() const;
+
+	bool isJpeg() const;
+
+	/**
+	Reads the dimensions of a bmp, jpeg or png image just from its header, without decoding it.
+	Returns false for other formats or for truncated headers.
+	*/
+	bool imageSize(unsigned &width, unsigned &height) const;
+};
+
+/// Input stream buffer reading directly from a ByteSpan, without copying it
+class ByteSpanStreamBuf : public std::streambuf {
+public:
+	ByteSpanStreamBuf(const ByteSpan &bytes);
+};
+
+/// Read-only memory mapping of a whole file, for large inputs
+class MappedFile {
+	std::string _name;
+	boost::interprocess::file_mapping mapping;
+	boost::interprocess::mapped_region region;
+
+public:
+	/// Throws invalid_argument when the file can't be mapped (missing or empty file)
+	MappedFile(const std::string &fileName);
+
+	MappedFile(const MappedFile&) = delete;
+	void operator=(const MappedFile&) = delete;
+
+	inline const std::string& name() const { return _name; }
+	inline ByteSpan bytes() const { return ByteSpan(region.get_address(), region.get_size()); }
+};
+
+#endif // H_MAZE_INPUT
@@ -0,0 +1,61 @@
+/******************************************************************
+ Project TiltedMaze solves tilted maze problems.
+
+ You might visit http://www.agame.com/game/tilt-maze
+ to try yourself solving such problems (use the arrow keys to move)
+
+ The program is able to load the puzzle from text files, but also
+ from captured snapshots, which contain various imperfections.
+ It is possible to recognize the original maze even when rotating,
+ mirroring the snapshot, or even after applying perspective
+ transformations on it.
+ 
+ Solving the maze is presented as an animation, either on console,
+ or within a normal window.
+
+ The project uses OpenCV and Boost.
+
+ Copyright (c) 2014, 2017 Florin Tulba
+
+*******************************************************************/
+
+#include "mazeSequence.h"
+
+#pragma warning( push, 0 )
+
+#include <sstream>
+
+#pragma warning( pop )
+
+using namespace std;
+using namespace cv;
+
+MazeSequence::MazeSequence(const string &videoOrImagesPattern, bool Verbose/* = false*/) :
+		sourceName(videoOrImagesPattern), source(videoOrImagesPattern), framesCount(0U), verbose(Verbose) {
+	if(false == source.isOpened())
+		throw invalid_argument("Couldn't open the video / images sequence " + videoOrImagesPattern);
+
+	buffers.trackMaze = true;
+}
+
+std::shared_ptr<const Maze> MazeSequence::next(bool &changed) {
+	changed = false;
+	if(false == source.read(frame) || frame.empty())
+		return nullptr;
+
+	ostringstream oss;
+	oss<<sourceName<<" [frame "<<framesCount++<<']';
+
+	std::shared_ptr<const Maze> maze;
+	try {
+		maze = make_shared<Maze>(frame, oss.str(), buffers, verbose);
+	} catch(...) {
+		buffers.trackedCorners.clear(); // the next frame needs a full detection
+		throw;
+	}
+
+	changed = (nullptr == lastMaze) || (false == maze->sameContent(*lastMaze));
+	lastMaze = maze;
+
+	return maze;
+}
@@ -0,0 +1,67 @@
+/******************************************************************
+ Project TiltedMaze solves tilted maze problems.
+
+ You might visit http://www.agame.com/game/tilt-maze
+ to try yourself solving such problems (use the arrow keys to move)
+
+ The program is able to load the puzzle from text files, but also
+ from captured snapshots, which contain various imperfections.
+ It is possible to recognize the original maze even when rotating,
+ mirroring the snapshot, or even after applying perspective
+ transformations on it.
+ 
+ Solving the maze is presented as an animation, either on console,
+ or within a normal window.
+
+ The project uses OpenCV and Boost.
+
+ Copyright (c) 2014, 2017 Florin Tulba
+
+*******************************************************************/
+
+#ifndef H_MAZE_SEQUENCE
+#define H_MAZE_SEQUENCE
+
+#include "mazeImageParser.h"
+
+#pragma warning( push, 0 )
+
+#include <string>
+#include <memory>
+
+#include <opencv2/videoio/videoio.hpp>
+
+#pragma warning( pop )
+
+/**
+Parses the mazes from the frames of a video file or of a numbered images sequence (like "capture/frame%04d.png").
+The maze gets fully detected only in the first frame. Its corners are then tracked from frame to frame,
+and the full detection is performed again only when the tracking fails.
+*/
+class MazeSequence {
+	std::string sourceName;		///< the video file / the pattern of the images sequence
+	cv::VideoCapture source;
+	cv::Mat frame;				///< the last read frame
+	unsigned framesCount;		///< frames read so far
+	ImageParsingBuffers buffers; ///< reused for every frame; they also keep the tracked maze corners
+	std::shared_ptr<const Maze> lastMaze; ///< the maze from the last successfully parsed frame
+	bool verbose;
+
+public:
+	/// Throws invalid_argument when the source can't be opened
+	MazeSequence(const std::string &videoOrImagesPattern, bool verbose = false);
+
+	MazeSequence(const MazeSequence&) = delete;
+	void operator=(const MazeSequence&) = delete;
+
+	/**
+	Parses the next frame and returns its maze or nullptr at the end of the sequence.
+	changed reports if the maze differs from the one from the previous parsed frame, so only then it needs solving again.
+	A frame that can't be parsed throws, but the sequence can continue with the next frame, where the maze is detected again.
+	*/
+	std::shared_ptr<const Maze> next(bool &changed);
+
+	inline unsigned frameIndex() const { return framesCount - 1U; } ///< index of the last read frame
+};
+
+#endif // H_MAZE_SEQUENCE
@@ -20,7 +20,6 @@
 *******************************************************************/
 
 #include "mazeSolver.h"
-#include "graph_r_c_shortest_paths.h"
 
 #pragma warning( push, 0 )
 
@@ -32,8 +31,6 @@ using namespace std;
 using namespace boost;
 using namespace boost::graph;
 
-extern Targets graphTargets;
-
 /// expected by check_r_c_path
 bool operator==(const BpResCont &rc1, const BpResCont &rc2) {
 	// the full walk must correspond when verifying with check_r_c_path
@@ -51,40 +48,52 @@ bool operator<(const BpResCont &rc1, const BpResCont &rc2) {
 }
 
 MazeSolver::MazeSolver(const std::string &mazeFile, bool verbose/* = false*/) :
-	theMaze(make_shared<Maze>(mazeFile, verbose), verbose) {}
+	query(make_shared<ProblemAdapter>(make_shared<Maze>(mazeFile, verbose), verbose)) {}
+
+MazeSolver::MazeSolver(const MazeQuery &aQuery) : query(aQuery) {}
 
 bool MazeSolver::isSolvable(vector< vector< graph_traits< BpAdjacencyList >::edge_descriptor > > 
 								*pOpt_solutions_spptw/* = nullptr*/,
 							vector< BpResCont > *pPareto_opt_rcs_spptw/* = nullptr*/) const {
-	const BpAdjacencyList &searchGraph = theMaze.getSearchGraph();
-	const size_t idxStartVertex = theMaze.getBranchlessPaths().size(),
-		idxEndVertex = idxStartVertex + 1ULL;
-
-	// spptw
-	vector< vector< graph_traits< BpAdjacencyList >::edge_descriptor > >  opt_solutions_spptw;
-	vector< BpResCont > pareto_opt_rcs_spptw;
+	SolverWorkspace workspace;
 	if(pOpt_solutions_spptw == nullptr)
-		pOpt_solutions_spptw = &opt_solutions_spptw;
+		pOpt_solutions_spptw = &workspace.solutions;
 	if(pPareto_opt_rcs_spptw == nullptr)
-		pPareto_opt_rcs_spptw = &pareto_opt_rcs_spptw;
+		pPareto_opt_rcs_spptw = &workspace.paretoOptRcs;
 
-	BpResExtensionFn bpRef;
-	BpDominanceFn bpDom;
+	return search(workspace, *pOpt_solutions_spptw, *pPareto_opt_rcs_spptw);
+}
+
+bool MazeSolver::isSolvable(SolverWorkspace &workspace) const {
+	return search(workspace, workspace.solutions, workspace.paretoOptRcs);
+}
+
+bool MazeSolver::search(SolverWorkspace &workspace, SolverWorkspace::Solutions &opt_solutions_spptw,
+						vector< BpResCont > &pareto_opt_rcs_spptw) const {
+	const ProblemAdapter &theMaze = *query.getProblem();
+	const BpAdjacencyList &searchGraph = theMaze.getSearchGraph();
+	const size_t idxStartVertex = theMaze.idxStartVertex(),
+		idxEndVertex = theMaze.idxEndVertex();
+
+	// spptw
+	BpResExtensionFn bpRef(query);
+	BpDominanceFn bpDom(query);
 
 	r_c_shortest_paths_dispatch_adapted(searchGraph,
 										get(&BpVertexProps::num, searchGraph),
 										get(&BpsArcProps::num, searchGraph),
 										idxStartVertex, idxEndVertex,
-										*pOpt_solutions_spptw, *pPareto_opt_rcs_spptw, true,
+										opt_solutions_spptw, pareto_opt_rcs_spptw, true,
 										BpResCont(), // empty uniqueTraversedBps & walk
 										bpRef, bpDom,
-										allocator< r_c_shortest_paths_label< BpAdjacencyList, BpResCont> >(),
+										workspace.searchBuffers,
 										BpGraphAlgVisitor());
 	
-	return pOpt_solutions_spptw->size() != 0ULL;
+	return opt_solutions_spptw.size() != 0ULL;
 }
 
 bool MazeSolver::solve(bool consoleMode/* = true*/, bool verbose/* = false*/) const {
+	const ProblemAdapter &theMaze = *query.getProblem();
 	const BpAdjacencyList &searchGraph = theMaze.getSearchGraph();
 
 	// spptw
@@ -110,19 +119,19 @@ bool MazeSolver::solve(bool consoleMode/* = true*/, bool verbose/* = false*/) co
 				   true,
 				   pareto_opt_rcs_spptw[0],
 				   actual_final_resource_levels,
-				   BpResExtensionFn(),
+				   BpResExtensionFn(query),
 				   b_is_a_path_at_all,
 				   b_feasible,
 				   b_correctly_extended,
 				   ed_last_extended_arc);
 
-	if(graphTargets.unvisited(actual_final_resource_levels.uniqueTraversedBps) > 0U)
+	if(query.unvisited(actual_final_resource_levels.uniqueTraversedBps) > 0U)
 		return false;
 
 	if(!b_is_a_path_at_all || !b_feasible || !b_correctly_extended)
 		return false;
 
-	list<BranchlessPath*> firstSolution;
+	list<const BranchlessPath*> firstSolution;
 	for(size_t j = 0U, walkLen = opt_solutions_spptw[0].size() - 1; j < walkLen; ++j) {
 		const BpVertexProps& aVertexProps =
 			get(vertex_bundle, searchGraph)[source(opt_solutions_spptw[0][j], searchGraph)];
@@ -150,14 +159,14 @@ bool MazeSolver::solve(bool consoleMode/* = true*/, bool verbose/* = false*/) co
 	// This is the case for every BranchlessPath that appears only once within the solution walk
 	// For those that reappear, the last visit is the one that must visit every target.
 	const size_t solSz = firstSolution.size();
-	vector<BranchlessPath*> solAsVector(BOUNDS_OF(firstSolution));
-	set<BranchlessPath*> uniqueBpsTraversed(BOUNDS_OF(solAsVector));
+	vector<const BranchlessPath*> solAsVector(BOUNDS_OF(firstSolution));
+	set<const BranchlessPath*> uniqueBpsTraversed(BOUNDS_OF(solAsVector));
 	vector<bool> allTargetsMustBeVisited(solSz, false);
 
 	for(auto uniqueBp : uniqueBpsTraversed) {
 		// find the position of the last uniqueBp within solAsVector
 		size_t idx = solSz-1;
-		vector<BranchlessPath*>::reverse_iterator rit = solAsVector.rbegin(), ritEnd = solAsVector.rend();
+		vector<const BranchlessPath*>::reverse_iterator rit = solAsVector.rbegin(), ritEnd = solAsVector.rend();
 		for(; rit != ritEnd; ++rit, --idx) {
 			if(uniqueBp == *rit) {
 				allTargetsMustBeVisited[idx] = true;
@@ -166,10 +175,12 @@ bool MazeSolver::solve(bool consoleMode/* = true*/, bool verbose/* = false*/) co
 		}
 	}
 
-	// perform the traversal
-	Coord fromCoord = theMaze.getMaze()->startLocation(), endCoord = solAsVector[0]->firstEnd();
+	// perform the traversal on a copy of the query, to keep this method const & reentrant
+	MazeQuery traversal(query);
+	traversal.resetVisits();
+	Coord fromCoord = query.startLocation(), endCoord = solAsVector[0]->firstEnd();
 	if(solSz == 1U) {
-		solAsVector[0]->traverse(fromCoord, endCoord, uiEngine, true, true); // stops after visiting all targets
+		solAsVector[0]->traverse(traversal, fromCoord, endCoord, uiEngine, true, true); // stops after visiting all targets
 
 	} else { // solution has at least 2 BP-s
 		// determine 1st intersection
@@ -179,7 +190,7 @@ bool MazeSolver::solve(bool consoleMode/* = true*/, bool verbose/* = false*/) co
 		// traverse all except last
 		size_t idx = 0, lim = solSz - 1U;
 		for(;;) {
-			solAsVector[idx]->traverse(fromCoord, endCoord, uiEngine, allTargetsMustBeVisited[idx]);
+			solAsVector[idx]->traverse(traversal, fromCoord, endCoord, uiEngine, allTargetsMustBeVisited[idx]);
 			fromCoord = endCoord;
 			endCoord = solAsVector[++idx]->firstEnd();
 
@@ -191,12 +202,10 @@ bool MazeSolver::solve(bool consoleMode/* = true*/, bool verbose/* = false*/) co
 		}
 
 		// traverse last
-		solAsVector[lim]->traverse(fromCoord, endCoord, uiEngine, true, true); // stops after visiting all targets
+		solAsVector[lim]->traverse(traversal, fromCoord, endCoord, uiEngine, true, true); // stops after visiting all targets
 	}
 
-	for(const auto &t : theMaze.getTargets()) {
-		require(t.visited(), "All targets should have been visited at the end of the walk!");
-	}
+	require(traversal.allTargetsVisited(), "All targets should have been visited at the end of the walk!");
 
 	return true;
 }
@@ -212,7 +221,7 @@ BpResCont& BpResCont::operator=(const BpResCont& other) {
 	return *this;
 }
 
-int BpResCont::lessUnvisitedOrAtLeastShorterWalkThan(const BpResCont &other) const {
+int BpResCont::lessUnvisitedOrAtLeastShorterWalkThan(const BpResCont &other, const MazeQuery &query) const {
 	int walkSzCompare = ::compare(other.walk.size(), walk.size()); // for shorter this.walk => 1
 
 	if(uniqueTraversedBps == other.uniqueTraversedBps) // this means also the unvisited targets count is the same
@@ -220,8 +229,8 @@ int BpResCont::lessUnvisitedOrAtLeastShorterWalkThan(const BpResCont &other) con
 
 	// Here the unique BPs of this and other differ,
 	// but the count of unvisited targets might be the same
-	unsigned unvisitedTargets1 = graphTargets.unvisited(uniqueTraversedBps);
-	unsigned unvisitedTargets2 = graphTargets.unvisited(other.uniqueTraversedBps);
+	unsigned unvisitedTargets1 = query.unvisited(uniqueTraversedBps);
+	unsigned unvisitedTargets2 = query.unvisited(other.uniqueTraversedBps);
 
 	int unvisitedTargetsCompare = ::compare(unvisitedTargets2, unvisitedTargets1); // returns 1 if this has less unvisited
 
@@ -243,7 +252,7 @@ int BpDominanceFn::operator() (const BpResCont &rc1, const BpResCont &rc2) const
 	// which can be detected as follows:
 
 	bool sameUniqueBPsTraversed = (rc1.uniqueTraversedBps == rc2.uniqueTraversedBps);
-	int rigurousCompareOfExistingWalks = rc1.lessUnvisitedOrAtLeastShorterWalkThan(rc2);
+	int rigurousCompareOfExistingWalks = rc1.lessUnvisitedOrAtLeastShorterWalkThan(rc2, query);
 
 	if(0 == rigurousCompareOfExistingWalks) { // same unvisited count & walk length
 		if(sameUniqueBPsTraversed) // rc2 is just a permutation of rc2
@@ -270,14 +279,14 @@ int BpDominanceFn::operator() (const BpResCont &rc1, const BpResCont &rc2) const
 	return 0; // ambiguous, better preserve both
 }
 
-int BpResCont::lessUnvisitedThan(const BpResCont &other) const {
+int BpResCont::lessUnvisitedThan(const BpResCont &other, const MazeQuery &query) const {
 	if(uniqueTraversedBps == other.uniqueTraversedBps) // this means also the unvisited targets count is the same
 		return 0;
 
 	// Here the unique BPs of this and other differ,
 	// but the count of unvisited targets might be the same
-	unsigned unvisitedTargets1 = graphTargets.unvisited(uniqueTraversedBps);
-	unsigned unvisitedTargets2 = graphTargets.unvisited(other.uniqueTraversedBps);
+	unsigned unvisitedTargets1 = query.unvisited(uniqueTraversedBps);
+	unsigned unvisitedTargets2 = query.unvisited(other.uniqueTraversedBps);
 
 	return ::compare(unvisitedTargets2, unvisitedTargets1); // returns 1 if this has less unvisited
 }
@@ -287,13 +296,17 @@ bool BpResExtensionFn::operator() (const BpAdjacencyList& g,
 								   graph_traits<BpAdjacencyList>::edge_descriptor ed) const {
 	int nextBp = (int)target(ed, g);
 	const BpVertexProps& vert_prop = get(vertex_bundle, g)[size_t(nextBp)];
-	BranchlessPath *tmNextBp = vert_prop.forTiltedMaze();
+	const BranchlessPath *tmNextBp = vert_prop.forTiltedMaze();
+
+	// The auxiliary start vertex is linked to every BP, but the walk may begin only from the start location of the query
+	if(source(ed, g) == query.getProblem()->idxStartVertex() && !query.isStartBp(*tmNextBp))
+		return false;
 
 	new_cont = old_cont;
 	new_cont.walk.push_back(tmNextBp);
 	new_cont.uniqueTraversedBps.insert(tmNextBp);
 
-	unsigned unvisited4_new_cont = graphTargets.unvisited(new_cont.uniqueTraversedBps);
+	unsigned unvisited4_new_cont = query.unvisited(new_cont.uniqueTraversedBps);
 	unsigned allowedUnvisitedCountByNextBp = vert_prop.maxUnvisitedTargets(); // this is always infinity, except BPend
 
 	return (unvisited4_new_cont <= allowedUnvisitedCountByNextBp);
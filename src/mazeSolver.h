@@ -23,6 +23,7 @@
 #define H_MAZE_SOLVER
 
 #include "problemAdapter.h"
+#include "graph_r_c_shortest_paths.h"
 
 /**
 ResourceContainer
@@ -34,8 +35,8 @@ where all targets must be already visited
 and they get removed
 */
 struct BpResCont {
-	std::list< BranchlessPath* >  walk; ///< the current path; its length matters for BpDominanceFn
-	std::set< BranchlessPath* >  uniqueTraversedBps; ///< the unique BPs within the walk
+	std::list< const BranchlessPath* >  walk; ///< the current path; its length matters for BpDominanceFn
+	std::set< const BranchlessPath* >  uniqueTraversedBps; ///< the unique BPs within the walk
 
 	BpResCont& operator=(const BpResCont& other);
 
@@ -49,14 +50,16 @@ struct BpResCont {
 	- superior to another if it covered more targets, or the same count, but within less steps (a shorter walk)
 	- equal to another if both, the targets count and the walk's length are the same, even for different walks
 
+	The targets to be counted are the ones required by query.
+
 	Returns:
 	-1 if this is worse than other ; 0 if equal ; 1 if this is better than other
 	justEquality parameter speeds up the control for equality
 	*/
-	int lessUnvisitedOrAtLeastShorterWalkThan(const BpResCont &other) const;
+	int lessUnvisitedOrAtLeastShorterWalkThan(const BpResCont &other, const MazeQuery &query) const;
 
 	/// Compare version that ignores the walk length
-	int lessUnvisitedThan(const BpResCont &other) const;
+	int lessUnvisitedThan(const BpResCont &other, const MazeQuery &query) const;
 
 	/// @return true if current walk contains more unique BranchlessPath-s (graph vertices) than the walk performed by other
 	inline int moreUniqueTraversedBpsThan(const BpResCont &other) const {
@@ -66,6 +69,10 @@ struct BpResCont {
 
 /// DominanceFunction model
 struct BpDominanceFn {
+	const MazeQuery &query; ///< provides the targets required by the current query
+
+	BpDominanceFn(const MazeQuery &aQuery) : query(aQuery) {}
+
 	/**
 	Compares for dominance 2 BpResCont-s
 	Returns:
@@ -78,6 +85,10 @@ struct BpDominanceFn {
 
 /// ResourceExtensionFunction model
 struct BpResExtensionFn {
+	const MazeQuery &query; ///< provides the start location and the targets required by the current query
+
+	BpResExtensionFn(const MazeQuery &aQuery) : query(aQuery) {}
+
 	/// Tackles the feasibility of a new edge and fills in the required data for the reached BP
 	bool operator() (const BpAdjacencyList& g, BpResCont& new_cont, const BpResCont& old_cont,
 					 boost::graph_traits<BpAdjacencyList>::edge_descriptor ed) const;
@@ -131,19 +142,50 @@ struct BpGraphAlgVisitor {
 	inline bool on_enter_loop(const Queue&, const Graph&) { return true; }
 };
 
-/// Loads and solves a maze
+/**
+Buffers needed while solving a maze, which preserve their capacity between solves.
+A worker solving many mazes one after the other should keep a SolverWorkspace and provide it to each
+MazeSolver::isSolvable call. Concurrent threads must use separate workspaces.
+*/
+struct SolverWorkspace {
+	typedef std::vector< std::vector< boost::graph_traits< BpAdjacencyList >::edge_descriptor > > Solutions;
+
+	boost::detail::r_c_shortest_paths_workspace< BpAdjacencyList, BpResCont > searchBuffers; ///< the labels, their queue and the labels of each vertex
+	Solutions solutions;			///< the found walks
+	std::vector< BpResCont > paretoOptRcs;	///< the resources at the end of the found walks
+};
+
+/**
+Loads and solves a maze.
+
+Several MazeSolver-s (even from different threads) might share the same loaded maze,
+each of them solving its own query (start location and targets).
+*/
 class MazeSolver {
-	ProblemAdapter theMaze;
+	MazeQuery query; ///< the shared read-only maze plus the particular start location and targets to visit
+
+	/// Searches the solutions using the buffers from workspace
+	bool search(SolverWorkspace &workspace, SolverWorkspace::Solutions &opt_solutions_spptw,
+				std::vector< BpResCont > &pareto_opt_rcs_spptw) const;
 
 public:
 	/// Loads the mazeFile and adapts it for the Boost graph algorithms
 	MazeSolver(const std::string &mazeFile, bool verbose = false);
 
+	/// Solves a query for an already loaded maze, without rebuilding or copying the maze or its graph
+	MazeSolver(const MazeQuery &aQuery);
+
+	inline const std::shared_ptr<const ProblemAdapter>& getProblem() const { return query.getProblem(); }
+
 	/// Checks if the maze is solvable. Both parameters might be nullptr (default) when called by foreign code
 	bool isSolvable(std::vector< std::vector< boost::graph_traits< BpAdjacencyList >::edge_descriptor > >
 						*pOpt_solutions_spptw = nullptr,
 					std::vector< BpResCont > *pPareto_opt_rcs_spptw = nullptr) const;
 
+	/// Checks if the maze is solvable reusing (without sharing it with other threads) the provided workspace.
+	/// The found solutions remain in workspace.solutions and workspace.paretoOptRcs
+	bool isSolvable(SolverWorkspace &workspace) const;
+
 	bool solve(bool consoleMode = true, bool verbose = false) const;
 };
 
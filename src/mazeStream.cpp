@@ -0,0 +1,109 @@
+/******************************************************************
+ Project TiltedMaze solves tilted maze problems.
+
+ You might visit http://www.agame.com/game/tilt-maze
+ to try yourself solving such problems (use the arrow keys to move)
+
+ The program is able to load the puzzle from text files, but also
+ from captured snapshots, which contain various imperfections.
+ It is possible to recognize the original maze even when rotating,
+ mirroring the snapshot, or even after applying perspective
+ transformations on it.
+ 
+ Solving the maze is presented as an animation, either on console,
+ or within a normal window.
+
+ The project uses OpenCV and Boost.
+
+ Copyright (c) 2014, 2017 Florin Tulba
+
+*******************************************************************/
+
+#include "mazeStream.h"
+#include "mazeInput.h"
+
+#pragma warning( push, 0 )
+
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+#pragma warning( pop )
+
+using namespace std;
+
+namespace {
+	const string recordsDelimiter("---"); ///< ends a text maze record
+
+	/// Reads a line without its terminator (either LF, or CR LF)
+	bool nextLine(istream &is, string &line) {
+		if(!getline(is, line))
+			return false;
+
+		if(false == line.empty() && '\r' == line.back())
+			line.pop_back();
+		return true;
+	}
+
+	/// Parses strictly the size of a blob: just decimal digits, without a sign or anything after them
+	bool parseBlobSize(istringstream &header, unsigned long long &bytesCount) {
+		string countText;
+		if(!(header>>countText) || !(header>>ws).eof())
+			return false;
+		if(false == all_of(CONST_BOUNDS_OF(countText), [] (char ch) { return ch >= '0' && ch <= '9'; }))
+			return false;
+
+		bytesCount = strtoull(countText.c_str(), nullptr, 10); // ULLONG_MAX when out of range
+		return 0ULL != bytesCount;
+	}
+}
+
+MazeStreamReader::MazeStreamReader(istream &is, const string &streamName/* = "stream"*/,
+								   ImageParsingBuffers *imgBuffers/* = nullptr*/) :
+		is(is), streamName(streamName), imgBuffers(imgBuffers), recordsCount(0ULL) {}
+
+shared_ptr<const Maze> MazeStreamReader::next(bool verbose/* = false*/) {
+	// Skipping any empty lines, comments and delimiters before the record
+	string line;
+	do {
+		if(false == nextLine(is, line))
+			return nullptr;
+	} while(line.empty() || ';' == line[0] || 0 == line.compare(recordsDelimiter));
+
+	ostringstream oss;
+	oss<<streamName<<" [record "<<++recordsCount<<']';
+	const string name = oss.str();
+
+	istringstream header(line);
+	string keyword;
+	header>>keyword;
+	if(0 == keyword.compare("blob")) {
+		unsigned long long bytesCount = 0ULL;
+		if(false == parseBlobSize(header, bytesCount))
+			throw invalid_argument("Expected the size of the blob from " + name);
+
+		if(bytesCount > (unsigned long long)MAX_BLOB_BYTES) {
+			// Skipping the blob keeps the reader aligned with the following record
+			for(unsigned long long left = bytesCount; left > 0ULL && is; left -= (unsigned long long)is.gcount())
+				is.ignore((streamsize)min(left, (unsigned long long)MAX_BLOB_BYTES));
+			throw invalid_argument("The blob from " + name + " is too large");
+		}
+
+		vector<char> blob((size_t)bytesCount);
+		if(!is.read(blob.data(), (streamsize)bytesCount))
+			throw runtime_error("The stream ended within " + name);
+
+		return make_shared<Maze>(ByteSpan(blob.data(), blob.size()), name, verbose, imgBuffers);
+	}
+
+	// A text maze, up to the delimiter or the end of the stream
+	string content(line);
+	content += '\n';
+	while(nextLine(is, line) && 0 != line.compare(recordsDelimiter)) {
+		content += line;
+		content += '\n';
+	}
+
+	return make_shared<Maze>(ByteSpan(content.data(), content.size()), name, verbose, imgBuffers);
+}
@@ -0,0 +1,70 @@
+/******************************************************************
+ Project TiltedMaze solves tilted maze problems.
+
+ You might visit http://www.agame.com/game/tilt-maze
+ to try yourself solving such problems (use the arrow keys to move)
+
+ The program is able to load the puzzle from text files, but also
+ from captured snapshots, which contain various imperfections.
+ It is possible to recognize the original maze even when rotating,
+ mirroring the snapshot, or even after applying perspective
+ transformations on it.
+ 
+ Solving the maze is presented as an animation, either on console,
+ or within a normal window.
+
+ The project uses OpenCV and Boost.
+
+ Copyright (c) 2014, 2017 Florin Tulba
+
+*******************************************************************/
+
+#ifndef H_MAZE_STREAM
+#define H_MAZE_STREAM
+
+#include "mazeStruct.h"
+
+#pragma warning( push, 0 )
+
+#include <istream>
+#include <string>
+#include <memory>
+
+#pragma warning( pop )
+
+/**
+Parses the maze records arriving through a stream (like stdin fed by a pipe), one record at a time.
+A record is either:
+- a text maze, ended by a line containing just "---" or by the end of the stream
+- a line "blob <bytes count>" followed by that many bytes: a binary maze or an encoded image
+Empty lines and comments (lines starting with ';') between records are ignored.
+Each maze is parsed as soon as its record is complete, without reading ahead.
+*/
+class MazeStreamReader {
+	enum { MAX_BLOB_BYTES = 256 * 1024 * 1024 }; ///< larger blobs are skipped without being allocated
+
+	std::istream &is;
+	std::string streamName;				///< used for naming the mazes: "<streamName> [record <index>]"
+	ImageParsingBuffers *imgBuffers;	///< reused for the image blobs, when provided
+	size_t recordsCount;				///< the records read so far
+
+public:
+	/// The stream should be opened in binary mode when it contains blobs
+	MazeStreamReader(std::istream &is, const std::string &streamName = "stream", ImageParsingBuffers *imgBuffers = nullptr);
+
+	MazeStreamReader(const MazeStreamReader&) = delete;
+	void operator=(const MazeStreamReader&) = delete;
+
+	inline size_t recordsRead() const { return recordsCount; }
+
+	/**
+	Reads and parses the next record or returns nullptr at the end of the stream.
+	Parsing errors are thrown, but the reader can continue with the following record.
+	Throws invalid_argument for a blob size that isn't just a positive decimal number
+	and for blobs larger than MAX_BLOB_BYTES (their bytes are skipped first).
+	Throws runtime_error when the stream ends within a blob.
+	*/
+	std::shared_ptr<const Maze> next(bool verbose = false);
+};
+
+#endif // H_MAZE_STREAM
\ No newline at end of file
@@ -20,7 +20,9 @@
 *******************************************************************/
 
 #include "mazeTextParser.h"
+#include "mazeBinary.h"
 #include "mazeImageParser.h"
+#include "mazeInput.h"
 #include "consoleMode.h"
 #include "graphicalMode.h"
 
@@ -33,6 +35,10 @@
 using namespace std;
 using namespace boost::filesystem;
 
+namespace {
+	const string supportedImgExtensions(".bmp.jpg.jpeg.png.tif.tiff"); ///< initialized before main, so it's safe to read from several threads
+}
+
 string Coord::toString() const {
 	ostringstream oss;
 	oss<<"( "<<row<<" , "<<col<<" )";
@@ -42,6 +48,64 @@ string Coord::toString() const {
 Maze::Maze(const string &mazeFile, bool verbose/* = false*/) :
 		_name(mazeFile), _rowsCount(0U), _columnsCount(0U), _rows(), _columns(),
 		_startLocation(), _targets() {
+	load(mazeFile, nullptr, verbose);
+}
+
+Maze::Maze(const string &mazeFile, ImageParsingBuffers &imgBuffers, bool verbose/* = false*/) :
+		_name(mazeFile), _rowsCount(0U), _columnsCount(0U), _rows(), _columns(),
+		_startLocation(), _targets() {
+	load(mazeFile, &imgBuffers, verbose);
+}
+
+Maze::Maze(const cv::Mat &bgrImg, const string &name, ImageParsingBuffers &imgBuffers, bool verbose/* = false*/) :
+		_name(name), _rowsCount(0U), _columnsCount(0U), _rows(), _columns(),
+		_startLocation(), _targets() {
+	ImageMazeParser(bgrImg, _rowsCount, _columnsCount, _startLocation, _targets, _rows, _columns, verbose, &imgBuffers);
+}
+
+Maze::Maze(const cv::Mat &bgrImg, const MazeLocation &location, const string &name,
+		   ImageParsingBuffers &imgBuffers, bool verbose/* = false*/) :
+		_name(name), _rowsCount(0U), _columnsCount(0U), _rows(), _columns(),
+		_startLocation(), _targets() {
+	ImageMazeParser(bgrImg, location, _rowsCount, _columnsCount, _startLocation, _targets, _rows, _columns, verbose, &imgBuffers);
+}
+
+Maze::Maze(const ByteSpan &content, const string &name, bool verbose/* = false*/, ImageParsingBuffers *imgBuffers/* = nullptr*/) :
+		_name(name), _rowsCount(0U), _columnsCount(0U), _rows(), _columns(),
+		_startLocation(), _targets() {
+	load(content, imgBuffers, verbose);
+}
+
+Maze::Maze(const MappedFile &mazeFile, bool verbose/* = false*/, ImageParsingBuffers *imgBuffers/* = nullptr*/) :
+		_name(mazeFile.name()), _rowsCount(0U), _columnsCount(0U), _rows(), _columns(),
+		_startLocation(), _targets() {
+	load(mazeFile.bytes(), imgBuffers, verbose);
+}
+
+void Maze::load(const ByteSpan &content, ImageParsingBuffers *imgBuffers, bool verbose) {
+	if(BinaryMazeParser::recognizes(content)) {
+		BinaryMazeParser(content, _rowsCount, _columnsCount, _startLocation, _targets, _rows, _columns, verbose);
+
+	} else if(content.isEncodedImage()) {
+		cv::Mat decoded = ImageMazeParser::decode(content,
+			(nullptr != imgBuffers) ? &imgBuffers->originalImg : nullptr); // reuses the allocated image, when possible
+		if(decoded.empty())
+			throw invalid_argument("The provided content isn't a valid image!");
+
+		ImageMazeParser(decoded, _rowsCount, _columnsCount, _startLocation, _targets, _rows, _columns, verbose, imgBuffers);
+
+	} else {
+		TextMazeParser(content, _rowsCount, _columnsCount, _startLocation, _targets, _rows, _columns, verbose);
+	}
+}
+
+bool Maze::sameContent(const Maze &other) const {
+	return _rowsCount == other._rowsCount && _columnsCount == other._columnsCount &&
+		_startLocation == other._startLocation && _targets == other._targets &&
+		_rows == other._rows && _columns == other._columns;
+}
+
+void Maze::load(const string &mazeFile, ImageParsingBuffers *imgBuffers, bool verbose) {
 	path mazeNameAsPath(mazeFile);
 	if(false == mazeNameAsPath.has_extension())
 		throw invalid_argument("The image provided as maze source has no extension!");
@@ -49,18 +113,18 @@ Maze::Maze(const string &mazeFile, bool verbose/* = false*/) :
 	string imgType(extension(mazeNameAsPath));
 	if(imgType.compare(".txt") == 0)
 		TextMazeParser(mazeFile, _rowsCount, _columnsCount, _startLocation, _targets, _rows, _columns, verbose);
-	else {
-#pragma warning ( disable: THREAD_UNSAFE_CONSTRUCTION )
-		static string supportedExtensions = ".bmp.jpg.jpeg.png.tif.tiff";
-#pragma warning ( default: THREAD_UNSAFE_CONSTRUCTION )
-		if(string::npos == supportedExtensions.find(imgType))
+	else if(imgType.compare(".tmz") == 0) {
+		MappedFile mappedFile(mazeFile);
+		BinaryMazeParser(mappedFile.bytes(), _rowsCount, _columnsCount, _startLocation, _targets, _rows, _columns, verbose);
+	} else {
+		if(string::npos == supportedImgExtensions.find(imgType))
 			throw invalid_argument("Unsupported image type!");
 
-		ImageMazeParser(mazeFile, _rowsCount, _columnsCount, _startLocation, _targets, _rows, _columns, verbose);
+		ImageMazeParser(mazeFile, _rowsCount, _columnsCount, _startLocation, _targets, _rows, _columns, verbose, imgBuffers);
 	}
 }
 
-std::shared_ptr<Maze::UiEngine> Maze::display(bool consoleMode/* = true*/) {
+std::shared_ptr<Maze::UiEngine> Maze::display(bool consoleMode/* = true*/) const {
 	if(consoleMode)
 		return make_shared<ConsoleUiEngine>(*this);
 
@@ -62,6 +62,12 @@ struct Coord {
 
 typedef std::pair<Coord, Coord> CoordsPair;
 
+struct ImageParsingBuffers; // defined in mazeImageParser.h
+struct MazeLocation; // defined in mazeImageParser.h
+struct ByteSpan; // defined in mazeInput.h
+class MappedFile; // defined in mazeInput.h
+namespace cv { class Mat; }
+
 class Maze {
 	std::string _name;
 
@@ -74,9 +80,37 @@ class Maze {
 	std::vector<boost::icl::split_interval_set<unsigned>> _rows;	///< limits for the horizontal segments
 	std::vector<boost::icl::split_interval_set<unsigned>> _columns;	///< limits for the vertical segments
 
+	/// Parses mazeFile, reusing imgBuffers for image mazes, when provided
+	void load(const std::string &mazeFile, ImageParsingBuffers *imgBuffers, bool verbose);
+
+	/// Parses content as an encoded image or as text, reusing imgBuffers for images, when provided
+	void load(const ByteSpan &content, ImageParsingBuffers *imgBuffers, bool verbose);
+
 public:
 	Maze(const std::string &mazeFile, bool verbose = false);
 
+	/// Same as above, but image mazes are parsed using the provided buffers, which are left for reuse by the next parsed image
+	Maze(const std::string &mazeFile, ImageParsingBuffers &imgBuffers, bool verbose = false);
+
+	/// Parses an already decoded BGR image (like a video frame). name just identifies the maze
+	Maze(const cv::Mat &bgrImg, const std::string &name, ImageParsingBuffers &imgBuffers, bool verbose = false);
+
+	/// Parses one of the mazes from a decoded BGR image containing several mazes (see ImageMazeParser::locateMazes)
+	Maze(const cv::Mat &bgrImg, const MazeLocation &location, const std::string &name,
+		 ImageParsingBuffers &imgBuffers, bool verbose = false);
+
+	/**
+	Parses a maze already in memory, without copying it. The content is an encoded image, a binary maze or the text format.
+	name just identifies the maze. Image mazes are parsed using imgBuffers, when provided
+	*/
+	Maze(const ByteSpan &content, const std::string &name, bool verbose = false, ImageParsingBuffers *imgBuffers = nullptr);
+
+	/// Parses a memory-mapped maze file (convenient for large inputs; binary mazes need no parsing)
+	Maze(const MappedFile &mazeFile, bool verbose = false, ImageParsingBuffers *imgBuffers = nullptr);
+
+	/// Compares everything except the names of the mazes
+	bool sameContent(const Maze &other) const;
+
 	inline const std::string& name() const { return _name; }
 
 	inline unsigned rowsCount() const { return _rowsCount; }
@@ -100,7 +134,7 @@ public:
 		virtual void drawMove(const Coord &from, const Coord &to) = 0;
 	};
 
-	std::shared_ptr<UiEngine> display(bool consoleMode = true); ///< Displays the maze in console/graphic mode
+	std::shared_ptr<UiEngine> display(bool consoleMode = true) const; ///< Displays the maze in console/graphic mode
 };
 
 #endif // H_MAZE_STRUCT
\ No newline at end of file
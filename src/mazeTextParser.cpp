@@ -20,12 +20,14 @@
 *******************************************************************/
 
 #include "mazeTextParser.h"
+#include "mazeInput.h"
 
 #pragma warning( push, 0 )
 
-#include <fstream>
-
-#include <boost/optional.hpp>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <algorithm>
 
 #pragma warning( pop )
 
@@ -33,31 +35,109 @@ using namespace std;
 using namespace boost;
 using namespace boost::icl;
 
-optional<string> nextRelevantLine(ifstream &ifs) {
-	string line;
-	for(;;) {
-		if(!getline(ifs, line))
-			return optional<string>(); // EOF or error
+namespace {
+	/// Whitespace, as skipped by operator>>
+	inline bool isSpace(char ch) {
+		return ' ' == ch || (ch >= '\t' && ch <= '\r');
+	}
 
-		// skip empty lines or comments
-		if((0 == line.compare("")) || (';' == line[0]))
-			continue;
+	/// Traverses the relevant lines (neither empty, nor comments) of a text already in memory
+	class RelevantLines {
+		const char *next, *end;
+
+	public:
+		RelevantLines(const ByteSpan &content) : next(content.data), end(content.data + content.size) {}
+
+		/// Provides [lineStart, lineEnd) - the next relevant line without its terminator. Returns false at the end of the text
+		bool nextLine(const char *&lineStart, const char *&lineEnd) {
+			while(next < end) {
+				lineStart = next;
+				const char *eol = static_cast<const char*>(memchr(next, '\n', size_t(end - next)));
+				lineEnd = (nullptr != eol) ? eol : end;
+				next = (nullptr != eol) ? eol + 1 : end;
+				if(lineEnd > lineStart && '\r' == lineEnd[-1])
+					--lineEnd; // CR LF terminators
+
+				// skip empty lines or comments
+				if(lineEnd > lineStart && ';' != *lineStart)
+					return true;
+			}
+			return false;
+		}
+	};
+
+	/// Extracts from a line the same tokens as an istringstream would, but without any allocation
+	class LineTokens {
+		const char *pos, *end;
 
-		return line;
+		void skipSpaces() {
+			while(pos < end && isSpace(*pos))
+				++pos;
+		}
+
+	public:
+		LineTokens(const char *lineStart, const char *lineEnd) : pos(lineStart), end(lineEnd) {}
+
+		/// Checks if the next word (sequence of non-space characters) is the expected one. Consumes it in that case
+		bool word(const char *expected) {
+			skipSpaces();
+			const size_t len = strlen(expected);
+			if(size_t(end - pos) < len || 0 != memcmp(pos, expected, len) || (pos + len < end && false == isSpace(pos[len])))
+				return false;
+
+			pos += len;
+			return true;
+		}
+
+		/// Reads a decimal number, saturated to UINT_MAX. When there's no number, returns false and leaves value unchanged
+		bool number(unsigned &value) {
+			skipSpaces();
+			if(pos == end || *pos < '0' || *pos > '9')
+				return false;
+
+			unsigned long long result = 0ULL;
+			for(; pos < end && *pos >= '0' && *pos <= '9'; ++pos)
+				result = min(result * 10ULL + unsigned(*pos - '0'), (unsigned long long)UINT_MAX);
+			value = (unsigned)result;
+			return true;
+		}
+
+		/// Reads the next non-space character. Returns false at the end of the line
+		bool character(char &ch) {
+			skipSpaces();
+			if(pos == end)
+				return false;
+
+			ch = *pos++;
+			return true;
+		}
+	};
+
+	/// Builds in one pass the intervals delimited by the provided walls (sorted and unique), within [0, limit)
+	split_interval_set<unsigned> intervalsBetween(const vector<unsigned> &walls, unsigned limit) {
+		split_interval_set<unsigned> sis;
+		unsigned from = 0U;
+		for(unsigned wall : walls) {
+			sis.add(sis.end(), interval<unsigned>::type(from, wall)); // the hint makes appending constant-time
+			from = wall;
+		}
+		sis.add(sis.end(), interval<unsigned>::type(from, limit));
+		return sis;
 	}
 }
 
-void TextMazeParser::process(const string &fileName, bool verbose/* = false*/) {
-	ifstream ifs(fileName);
-	optional<string> line;
+void TextMazeParser::process(const ByteSpan &content, bool verbose/* = false*/) {
+	RelevantLines lines(content);
+	const char *lineStart = nullptr, *lineEnd = nullptr;
 
 	// Reading the size of the maze
 	{
-		if( ! (line = nextRelevantLine(ifs)) )
+		if(false == lines.nextLine(lineStart, lineEnd))
 			throw runtime_error("The provided maze file ended before specifying the maze size!");
 
-		istringstream iss(*line);
-		iss>>rowsCount>>columnsCount;
+		LineTokens tokens(lineStart, lineEnd);
+		if(false == tokens.number(rowsCount) || false == tokens.number(columnsCount))
+			rowsCount = columnsCount = 0U;
 		if(rowsCount==0U || columnsCount==0U)
 			throw out_of_range("Read invalid maze size!");
 
@@ -65,75 +145,67 @@ void TextMazeParser::process(const string &fileName, bool verbose/* = false*/) {
 			PRINTLN(rowsCount);
 			PRINTLN(columnsCount);
 		}
-
-		unsigned i;
-		rows.reserve(rowsCount);
-		for(i = 0U; i<rowsCount; ++i) {
-			split_interval_set<unsigned> sis;
-			sis += interval<unsigned>::type(0U, columnsCount);
-			rows.push_back(sis);
-		}
-
-		columns.reserve(columnsCount);
-		for(i = 0U; i<columnsCount; ++i) {
-			split_interval_set<unsigned> sis;
-			sis += interval<unsigned>::type(0U, rowsCount);
-			columns.push_back(sis);
-		}
 	}
 
-	// Reading the rows & columns intervals
+	// Reading the rows & columns walls, which get sorted and turned into intervals at the end
+	vector<vector<unsigned>> rowsWalls(rowsCount), columnsWalls(columnsCount);
 	for(;;) {
-		string type;
-		unsigned index = UINT_MAX;
-		bool isRowInterval = false;
-		char colonCh;
-		if( ! (line = nextRelevantLine(ifs)) )
+		if(false == lines.nextLine(lineStart, lineEnd))
 			throw domain_error("The provided maze file doesn't specify neither a start location, nor any target!");
 
-		istringstream iss(*line);
-		iss>>type;
-		if((0 == type.compare("row"))) isRowInterval = true;
-		else if((0 == type.compare("column"))) isRowInterval = false;
+		LineTokens tokens(lineStart, lineEnd);
+		bool isRowInterval = false;
+		if(tokens.word("row")) isRowInterval = true;
+		else if(tokens.word("column")) isRowInterval = false;
 		else
 			break; // no more rows, nor columns - just read the start location
 
-		iss>>index;
+		unsigned index = UINT_MAX;
+		tokens.number(index);
 		if(index >= (isRowInterval ? rowsCount : columnsCount))
 			throw out_of_range("The provided maze file refers to an invalid row/column based on the specified maze dimensions!");
 
-		iss>>colonCh;
+		char colonCh = '\0';
+		tokens.character(colonCh);
 		if(colonCh != ':')
 			throw invalid_argument("Expected ':' before the walls' indexes while parsing a row/column declaration.");
 
 		if(verbose)
-	 		cout<<type<<' '<<index<<':';
+			cout<<(isRowInterval ? "row" : "column")<<' '<<index<<':';
 
+		const unsigned wallsLimit = isRowInterval ? columnsCount : rowsCount;
+		vector<unsigned> &walls = isRowInterval ? rowsWalls[index] : columnsWalls[index];
 		for(unsigned wallIndex = UINT_MAX;; wallIndex = UINT_MAX) {
-			iss>>wallIndex;
-			if(UINT_MAX == wallIndex)
+			if(false == tokens.number(wallIndex) || UINT_MAX == wallIndex)
 				break; // read last wall index from the line
 
 			++wallIndex; // The read value still falls within the previous interval
-			if(wallIndex >= (isRowInterval ? columnsCount : rowsCount))
+			if(wallIndex >= wallsLimit)
 				throw out_of_range("The provided maze file refers to an invalid wall index given the specified maze dimensions!");
 
 			if(verbose)
-	 			cout<<' '<<wallIndex;
+				cout<<' '<<wallIndex;
 
-			if(isRowInterval) {
-				rows[index] += interval<unsigned>::type(wallIndex, columnsCount);
-			} else {
-				columns[index] += interval<unsigned>::type(wallIndex, rowsCount);
-			}
+			walls.push_back(wallIndex);
 		}
 		if(verbose)
-	 		cout<<endl;
+			cout<<endl;
 	}
 
+	const auto buildIntervals = [] (vector<vector<unsigned>> &allWalls, unsigned wallsLimit,
+									vector<split_interval_set<unsigned>> &rowsOrColumns) {
+		rowsOrColumns.reserve(allWalls.size());
+		for(auto &walls : allWalls) {
+			sort(BOUNDS_OF(walls));
+			walls.erase(unique(BOUNDS_OF(walls)), walls.end());
+			rowsOrColumns.push_back(intervalsBetween(walls, wallsLimit));
+		}
+	};
+	buildIntervals(rowsWalls, columnsCount, rows);
+	buildIntervals(columnsWalls, rowsCount, columns);
+
 	if(verbose) {
-#pragma warning ( disable : THREAD_UNSAFE_CONSTRUCTION )
-		static const auto showRanges = [] (const vector<split_interval_set<unsigned>> &rowsOrColumns) {
+		const auto showRanges = [] (const vector<split_interval_set<unsigned>> &rowsOrColumns) {
 			for(const auto &sis : rowsOrColumns) {
 				cout<<'{';
 				for(const auto &limPair : sis) {
@@ -142,16 +214,16 @@ void TextMazeParser::process(const string &fileName, bool verbose/* = false*/) {
 				cout<<"}, ";
 			}
 		};
-#pragma warning ( default : THREAD_UNSAFE_CONSTRUCTION )
 		cout<<"custom_delims<ContDelims<>>(rows) = "; showRanges(rows); cout<<endl;
 		cout<<"custom_delims<ContDelims<>>(columns) = "; showRanges(columns); cout<<endl;
 	}
 
 	// Parsing the Starting location from the last read line
 	{
-		istringstream iss(*line);
+		LineTokens tokens(lineStart, lineEnd);
 		startLocation.reset();
-		iss>>startLocation.row>>startLocation.col;
+		if(tokens.number(startLocation.row))
+			tokens.number(startLocation.col);
 		if(startLocation.row>=rowsCount || startLocation.col>=columnsCount)
 			throw out_of_range("The provided maze file specifies an invalid starting location given the configured maze dimensions!");
 
@@ -161,16 +233,17 @@ void TextMazeParser::process(const string &fileName, bool verbose/* = false*/) {
 
 	// Reading the targets
 	for(bool targetsFound = false;;) {
-		if( ! (line = nextRelevantLine(ifs)) ) {
+		if(false == lines.nextLine(lineStart, lineEnd)) {
 			if(false == targetsFound)
 				throw domain_error("The provided maze file doesn't specify any targets!");
 
 			break;
 		}
 
-		istringstream iss(*line);
+		LineTokens tokens(lineStart, lineEnd);
 		Coord target;
-		iss>>target.row>>target.col;
+		if(tokens.number(target.row))
+			tokens.number(target.col);
 		if(target.row>=rowsCount || target.col>=columnsCount)
 			throw out_of_range("The provided maze file specifies an invalid target given the configured maze dimensions!");
 
@@ -194,5 +267,35 @@ TextMazeParser::TextMazeParser(const string &fileName,
 				   vector<split_interval_set<unsigned>> &columns,
 				   bool verbose/* = false*/) :
 		rowsCount(rowsCount), columnsCount(columnsCount), startLocation(startLocation), targets(targets), rows(rows), columns(columns) {
-	process(fileName, verbose);
+	unique_ptr<MappedFile> mappedFile;
+	try {
+		mappedFile.reset(new MappedFile(fileName));
+	} catch(invalid_argument&) {} // a missing or empty file is reported below as lacking the maze size
+
+	process((nullptr != mappedFile) ? mappedFile->bytes() : ByteSpan(), verbose);
+}
+
+TextMazeParser::TextMazeParser(istream &is,
+				   unsigned &rowsCount,
+				   unsigned &columnsCount,
+				   Coord &startLocation,
+				   vector<Coord> &targets,
+				   vector<split_interval_set<unsigned>> &rows,
+				   vector<split_interval_set<unsigned>> &columns,
+				   bool verbose/* = false*/) :
+		rowsCount(rowsCount), columnsCount(columnsCount), startLocation(startLocation), targets(targets), rows(rows), columns(columns) {
+	const string content((istreambuf_iterator<char>(is)), istreambuf_iterator<char>()); // read at once
+	process(ByteSpan(content.data(), content.size()), verbose);
+}
+
+TextMazeParser::TextMazeParser(const ByteSpan &content,
+				   unsigned &rowsCount,
+				   unsigned &columnsCount,
+				   Coord &startLocation,
+				   vector<Coord> &targets,
+				   vector<split_interval_set<unsigned>> &rows,
+				   vector<split_interval_set<unsigned>> &columns,
+				   bool verbose/* = false*/) :
+		rowsCount(rowsCount), columnsCount(columnsCount), startLocation(startLocation), targets(targets), rows(rows), columns(columns) {
+	process(content, verbose);
 }
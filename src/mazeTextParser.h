@@ -24,6 +24,12 @@
 
 #include "mazeStruct.h"
 
+#pragma warning( push, 0 )
+
+#include <istream>
+
+#pragma warning( pop )
+
 /// Loads a maze from text input file
 class TextMazeParser {
 	unsigned &rowsCount, &columnsCount;
@@ -33,7 +39,8 @@ class TextMazeParser {
 
 	std::vector<boost::icl::split_interval_set<unsigned>> &rows, &columns;
 
-	void process(const std::string &fileName, bool verbose = false);
+	/// Parses the whole text at once, with a tokenizer working directly on the characters
+	void process(const ByteSpan &content, bool verbose = false);
 
 public:
 	TextMazeParser(const std::string &fileName,
@@ -44,6 +51,26 @@ public:
 				   std::vector<boost::icl::split_interval_set<unsigned>> &rows,
 				   std::vector<boost::icl::split_interval_set<unsigned>> &columns,
 				   bool verbose = false);
+
+	/// Reads the whole stream and parses it
+	TextMazeParser(std::istream &is,
+				   unsigned &rowsCount,
+				   unsigned &columnsCount,
+				   Coord &startLocation,
+				   std::vector<Coord> &targets,
+				   std::vector<boost::icl::split_interval_set<unsigned>> &rows,
+				   std::vector<boost::icl::split_interval_set<unsigned>> &columns,
+				   bool verbose = false);
+
+	/// Parses a maze already in memory (like a mapped file), without copying it
+	TextMazeParser(const ByteSpan &content,
+				   unsigned &rowsCount,
+				   unsigned &columnsCount,
+				   Coord &startLocation,
+				   std::vector<Coord> &targets,
+				   std::vector<boost::icl::split_interval_set<unsigned>> &rows,
+				   std::vector<boost::icl::split_interval_set<unsigned>> &columns,
+				   bool verbose = false);
 };
 
 #endif // H_MAZE_TEXT_PARSER
\ No newline at end of file
@@ -32,19 +32,37 @@ using namespace boost;
 using namespace boost::icl;
 using namespace boost::graph;
 
-Targets graphTargets;
-
-ProblemAdapter::ProblemAdapter(std::shared_ptr<Maze> aMaze, bool verbose/* = false*/) :
+ProblemAdapter::ProblemAdapter(std::shared_ptr<const Maze> aMaze, bool verbose/* = false*/) :
 		maze(aMaze),
 		hSegments(), vSegments(),
-		orphanSegments(),
 		coordOwners(),
 		branchlessPaths(),
-		targets(aMaze->targets().begin(), aMaze->targets().end()),
+		targets(),
+		graphTargets(),
 		searchGraph() {
+	const vector<Coord> &mazeTargets = aMaze->targets();
+	targets.reserve(mazeTargets.size());
+	for(const auto &t : mazeTargets)
+		targets.emplace_back(t, (unsigned)targets.size());
+
 	buildGraph(verbose);
 }
 
+PSegmentsPair ProblemAdapter::ownersOf(const Coord &coord) const {
+	if(coord.row >= maze->rowsCount() || coord.col >= maze->columnsCount())
+		return PSegmentsPair(nullptr, nullptr);
+
+	return coordOwners[(size_t)coord.row * maze->columnsCount() + coord.col];
+}
+
+const MazeTarget* ProblemAdapter::targetAt(const Coord &coord) const {
+	for(const auto &t : targets)
+		if(t == coord)
+			return &t;
+
+	return nullptr;
+}
+
 void ProblemAdapter::buildGraph(bool verbose/* = false*/) {
 	// determine the number of horizontal segments
 	unsigned hSegmentsCount = 0U, vSegmentsCount = 0U, i;
@@ -53,15 +71,17 @@ void ProblemAdapter::buildGraph(bool verbose/* = false*/) {
 	}
 	hSegments.reserve(hSegmentsCount);
 
+	const unsigned columnsCount = maze->columnsCount();
+	coordOwners.assign((size_t)maze->rowsCount() * columnsCount, PSegmentsPair(nullptr, nullptr));
+
 	i = 0U;
 	for(const auto &sis : maze->rows()) {
 		for(const auto &iut : sis) {
 			if(iut.upper() - iut.lower() > 1U) { // single cells don't constitute segments
 				hSegments.emplace_back(i, iut);
 				Segment &seg = hSegments.back();
-				orphanSegments.insert(&seg);
 				for(unsigned j = iut.lower(), jLim = iut.upper(); j < jLim; ++j)
-					coordOwners[Coord(i, j)].first = &seg;
+					coordOwners[(size_t)i * columnsCount + j].first = &seg;
 			}
 		}
 		++i;
@@ -85,9 +105,8 @@ void ProblemAdapter::buildGraph(bool verbose/* = false*/) {
 			if(iut.upper() - iut.lower() > 1U) { // single cells don't constitute segments
 				vSegments.emplace_back(i, iut, false);
 				Segment &seg = vSegments.back();
-				orphanSegments.insert(&seg);
 				for(unsigned j = iut.lower(), jLim = iut.upper(); j < jLim; ++j)
-					coordOwners[Coord(j, i)].second = &seg;
+					coordOwners[(size_t)j * columnsCount + i].second = &seg;
 			}
 		}
 		++i;
@@ -102,7 +121,7 @@ void ProblemAdapter::buildGraph(bool verbose/* = false*/) {
 
 	// placing the targets on the appropriate segments
 	for(auto &targetCoord : targets) {
-		PSegmentsPair hvSegments = coordOwners[targetCoord];
+		PSegmentsPair hvSegments = ownersOf(targetCoord);
 		Segment *hSeg = hvSegments.first, *vSeg = hvSegments.second;
 		bool hFound = (nullptr != hSeg), vFound = (nullptr != vSeg);
 		require(hFound || vFound, "At least one segment should cover each Coord!");
@@ -115,12 +134,22 @@ void ProblemAdapter::buildGraph(bool verbose/* = false*/) {
 
 
 	// creating the branchlessPaths
-	for(i = 0U; false == orphanSegments.empty(); ++i) {
-		set<Segment*>::iterator it = orphanSegments.begin();
-		std::shared_ptr<BranchlessPath> pBranchlessPath = make_shared<BranchlessPath>(i, *(*it), orphanSegments, coordOwners);
-		branchlessPaths.push_back(pBranchlessPath);
+	// Before grouping the segments into paths (without bifurcations) they are considered orphans (they have no owner)
+	i = 0U;
+	for(auto pSegments : { &hSegments, &vSegments }) {
+		for(auto &seg : *pSegments) {
+			if(seg.hasOwner())
+				continue;
+
+			std::shared_ptr<BranchlessPath> pBranchlessPath = make_shared<BranchlessPath>(i++, seg, *this);
+			branchlessPaths.push_back(pBranchlessPath);
+		}
 	}
 
+	// all paths exist now, so their links can be established
+	for(auto pBranchlessPath : branchlessPaths)
+		pBranchlessPath->setLinksOwners();
+
 	if(verbose) {
 		for(auto e : branchlessPaths) {
 			cout<<string(60, '=')<<endl;
@@ -130,9 +159,9 @@ void ProblemAdapter::buildGraph(bool verbose/* = false*/) {
 
 	// introducing the targets into the required structure
 	graphTargets.clear();
-	for(auto &targetCoord : targets) {
+	for(const auto &targetCoord : targets) {
 		BranchlessPath *bp = nullptr;
-		PSegmentsPair hvSegments = coordOwners[targetCoord];
+		PSegmentsPair hvSegments = ownersOf(targetCoord);
 		Segment *seg = hvSegments.first;
 		if(nullptr != seg) {
 			bp = seg->owner();
@@ -154,8 +183,8 @@ void ProblemAdapter::buildGraph(bool verbose/* = false*/) {
 
 	// Introducing a virtual (auxiliary) start vertex (idx -1) that doesn't correspond to any BP
 	// Used just to create a single start point instead of 2, as the start position may belong to 2 BPs
-	const int idxStartVertex = (int)branchlessPaths.size();
-	const int idxEndVertex = idxStartVertex + 1;
+	const int idxStartVertex = (int)this->idxStartVertex();
+	const int idxEndVertex = (int)this->idxEndVertex();
 	add_vertex(BpVertexProps(idxStartVertex), searchGraph);
 
 	// Introducing also a virtual (auxiliary) end vertex (last idx)
@@ -166,15 +195,10 @@ void ProblemAdapter::buildGraph(bool verbose/* = false*/) {
 	// THE EDGES
 	int edgeIdx = 0;
 
-	// there are 1/2 BP-s to start from (the Start coordinate belongs both to 1 or 2 BPs)
-	PSegmentsPair hvSegsForStart = coordOwners[maze->startLocation()];
-	Segment *seg = hvSegsForStart.first;
-	if(nullptr != seg) {
-		add_edge((size_t)idxStartVertex, (size_t)seg->owner()->id(), BpsArcProps(edgeIdx++), searchGraph);
-	}
-	seg = hvSegsForStart.second;
-	if(nullptr != seg) {
-		add_edge((size_t)idxStartVertex, (size_t)seg->owner()->id(), BpsArcProps(edgeIdx++), searchGraph);
+	// The start location depends on the query, so the start vertex is linked to every BP.
+	// Each query accepts only the 1/2 BP-s containing its start location (see BpResExtensionFn)
+	for(auto pVertex : branchlessPaths) {
+		add_edge((size_t)idxStartVertex, (size_t)pVertex->id(), BpsArcProps(edgeIdx++), searchGraph);
 	}
 
 	for(auto pVertex : branchlessPaths) {
@@ -191,50 +215,100 @@ void ProblemAdapter::buildGraph(bool verbose/* = false*/) {
 		cout<<"Graph built!"<<endl;
 }
 
-void Targets::addTarget(MazeTarget &t, BranchlessPath &ownerBp) {
+void Targets::addTarget(const MazeTarget &t, const BranchlessPath &ownerBp) {
 	initialTargetBpMapping[&t].insert(&ownerBp);
 }
 
 // version ONLY for targets SHARED by idx1stSharer and idx2ndSharer
-void Targets::addTarget(MazeTarget &t,
-									BranchlessPath &sharerBp1, BranchlessPath &sharerBp2) {
-	initialTargetBpMapping[&t] = set< BranchlessPath* >{&sharerBp1, &sharerBp2};
+void Targets::addTarget(const MazeTarget &t,
+									const BranchlessPath &sharerBp1, const BranchlessPath &sharerBp2) {
+	initialTargetBpMapping[&t] = set< const BranchlessPath* >{&sharerBp1, &sharerBp2};
 }
 
-// Returns the number of unvisited targets remaining after any walk that covers the BPs within traversedBps
+// Returns the number of required targets remaining unvisited after any walk that covers the BPs within traversedBps
 // If parameter unvisitedTargets != nullptr, it copies the remaining unvisited targets into it
-unsigned Targets::unvisited(const set<BranchlessPath*> &traversedBps,
-										set<MazeTarget*> *unvisitedTargets/* = nullptr*/) const {
+unsigned Targets::unvisited(const set<const BranchlessPath*> &traversedBps,
+										const vector<bool> &requiredTargets,
+										set<const MazeTarget*> *unvisitedTargets/* = nullptr*/) const {
 	bool reportsTargetsToo = (unvisitedTargets != nullptr);
 	unsigned result = 0U;
 
-	set<BranchlessPath*> relevantBps;
-	for(auto tBpM : initialTargetBpMapping) {
-		set_intersection(BOUNDS_OF(tBpM.second),
-						 BOUNDS_OF(traversedBps),
-						 inserter(relevantBps, relevantBps.begin()));
-		if(relevantBps.empty()) {
+	for(const auto &tBpM : initialTargetBpMapping) {
+		if(false == requiredTargets[tBpM.first->idx()])
+			continue; // the query doesn't care about this target
+
+		// tBpM.second has only 1..2 BPs, so checking each of them within traversedBps is cheap
+		bool visited = false;
+		for(auto bp : tBpM.second) {
+			if(traversedBps.find(bp) != traversedBps.cend()) {
+				visited = true;
+				break;
+			}
+		}
+
+		if(false == visited) {
 			++result;
 
 			if(reportsTargetsToo)
 				unvisitedTargets->insert(tBpM.first);
-
-		} else {
-			relevantBps.clear();
 		}
 	}
 
 	return result;
 }
 
-void MazeTarget::visit() {
-	_visited = true;
+MazeQuery::MazeQuery(std::shared_ptr<const ProblemAdapter> aProblem) :
+		problem(aProblem), _startLocation(aProblem->getMaze()->startLocation()),
+		required(aProblem->getTargets().size(), true), pending(), startBps() {
+	init();
+}
+
+MazeQuery::MazeQuery(std::shared_ptr<const ProblemAdapter> aProblem, const Coord &startLocation,
+					 const vector<Coord> &targetsSubset) :
+		problem(aProblem), _startLocation(startLocation),
+		required(aProblem->getTargets().size(), false), pending(), startBps() {
+	const std::shared_ptr<const Maze> &maze = aProblem->getMaze();
+	if(startLocation.row >= maze->rowsCount() || startLocation.col >= maze->columnsCount())
+		throw out_of_range("The query specifies an invalid starting location given the maze dimensions!");
+
+	if(targetsSubset.empty())
+		throw invalid_argument("The query must specify at least one target!");
+
+	for(const auto &coord : targetsSubset) {
+		const MazeTarget *t = aProblem->targetAt(coord);
+		if(nullptr == t)
+			throw invalid_argument("The query specifies a target that doesn't belong to the maze!");
+
+		required[t->idx()] = true;
+	}
+
+	init();
+}
+
+void MazeQuery::init() {
+	pending = required;
+
+	PSegmentsPair hvSegsForStart = problem->ownersOf(_startLocation);
+	if(nullptr != hvSegsForStart.first)
+		startBps.push_back(hvSegsForStart.first->owner()->id());
+	if(nullptr != hvSegsForStart.second)
+		startBps.push_back(hvSegsForStart.second->owner()->id());
+}
 
-	if(visitors.first != nullptr)
-		visitors.first->ackVisit(*this);
+bool MazeQuery::isStartBp(const BranchlessPath &bp) const {
+	return find(CONST_BOUNDS_OF(startBps), bp.id()) != startBps.cend();
+}
+
+bool MazeQuery::allTargetsVisited() const {
+	return find(CONST_BOUNDS_OF(pending), true) == pending.cend();
+}
 
-	if(visitors.second != nullptr)
-		visitors.second->ackVisit(*this);
+void MazeQuery::visit(const MazeTarget &t) {
+	pending[t.idx()] = false;
+}
+
+void MazeQuery::resetVisits() {
+	pending = required;
 }
 
 Segment::Segment(const Coord &coord1, const Coord &coord2) : parent(nullptr) {
@@ -269,18 +343,18 @@ bool Segment::containsCoord(unsigned row, unsigned col, bool exceptEnds/* = fals
 	return  contains(closedInterval, nfi);
 }
 
-Segment::RangeUnvisited Segment::unvisitedTargets(const Coord *from /* = nullptr*/, const Coord *end /* = nullptr*/) const {
-	UTargetMap::const_iterator itEnd = varDimUnvisitedTargets.end();
-	if(varDimUnvisitedTargets.empty())
+Segment::RangeTargets Segment::targetsBetween(const Coord *from /* = nullptr*/, const Coord *end /* = nullptr*/) const {
+	UTargetMap::const_iterator itEnd = varDimTargets.end();
+	if(varDimTargets.empty())
 		return make_pair(itEnd, itEnd);
 
-	// varDimUnvisitedTargets is here non-empty
+	// varDimTargets is here non-empty
 
 	bool limitsProvided = (from != nullptr);
 	require(((end != nullptr) == limitsProvided), "Either both parameter or none must be nullptr!");
 
 	if(false == limitsProvided)
-		return make_pair(varDimUnvisitedTargets.begin(), itEnd);
+		return make_pair(varDimTargets.begin(), itEnd);
 
 	// limitsProvided is here true
 
@@ -302,8 +376,8 @@ Segment::RangeUnvisited Segment::unvisitedTargets(const Coord *from /* = nullptr
 	UUpair limitsMinMax;
 	limitsMinMax = minmax(*varFrom, *varEnd);
 	UTargetMap::const_iterator
-		itLimMin = varDimUnvisitedTargets.lower_bound(limitsMinMax.first),
-		itLimMax = varDimUnvisitedTargets.upper_bound(limitsMinMax.second);
+		itLimMin = varDimTargets.lower_bound(limitsMinMax.first),
+		itLimMax = varDimTargets.upper_bound(limitsMinMax.second);
 
 	return make_pair(itLimMin, itLimMax);
 }
@@ -317,42 +391,39 @@ Coord Segment::nextToEnd(const Coord &end) const {
 	return Coord(varDim, fixedIndex);
 }
 
-bool Segment::hasUnvisitedTargets(const Coord *from/* = nullptr*/, const Coord *end/* = nullptr*/) const {
-	RangeUnvisited rangeUnvisited = unvisitedTargets(from, end);
-	return distance(rangeUnvisited.first, rangeUnvisited.second) > 0;
+bool Segment::hasUnvisitedTargets(const MazeQuery &query, const Coord *from/* = nullptr*/, const Coord *end/* = nullptr*/) const {
+	RangeTargets rangeTargets = targetsBetween(from, end);
+	for(UTargetMap::const_iterator it = rangeTargets.first; it != rangeTargets.second; ++it) {
+		if(query.isPending(*it->second))
+			return true;
+	}
+	return false;
 }
 
-set<MazeTarget*> Segment::getUnvisitedTargets(const Coord *from/* = nullptr*/, const Coord *end/* = nullptr*/) const {
-	set<MazeTarget*> result;
-	RangeUnvisited rangeUnvisited = unvisitedTargets(from, end);
-	UTargetMap::const_iterator it = rangeUnvisited.first, itEnd = rangeUnvisited.second;
+set<const MazeTarget*> Segment::getUnvisitedTargets(const MazeQuery &query, const Coord *from/* = nullptr*/, const Coord *end/* = nullptr*/) const {
+	set<const MazeTarget*> result;
+	RangeTargets rangeTargets = targetsBetween(from, end);
+	UTargetMap::const_iterator it = rangeTargets.first, itEnd = rangeTargets.second;
 	for(; it != itEnd; ++it) {
-		result.insert(it->second);
+		if(query.isPending(*it->second))
+			result.insert(it->second);
 	}
 	return result;
 }
 
-void Segment::manageTarget(MazeTarget &target) {
+void Segment::manageTarget(const MazeTarget &target) {
 	require(containsCoord(target), "Provided MazeTarget can't be on this segment!");
-	managedTargets.push_back(&target);
 	unsigned varDim = (_isHorizontal ? target.col : target.row);
-	varDimUnvisitedTargets[varDim] = &target;
+	varDimTargets[varDim] = &target;
 }
 
-void Segment::ackVisit(const MazeTarget &target) {
-	require(containsCoord(target), "Provided MazeTarget can't be on this segment!");
-	const unsigned varDim = (_isHorizontal ? target.col : target.row);
-	require(1U == varDimUnvisitedTargets.erase(varDim), "No such target was found!");
-}
-
-void Segment::traverse(const Coord *from/* = nullptr*/, const Coord *end/* = nullptr*/) {
-	RangeUnvisited rangeUnvisited = unvisitedTargets(from, end);
-	while(rangeUnvisited.first != rangeUnvisited.second) {
-		MazeTarget *target = rangeUnvisited.first->second;
+void Segment::traverse(MazeQuery &query, const Coord *from/* = nullptr*/, const Coord *end/* = nullptr*/) const {
+	RangeTargets rangeTargets = targetsBetween(from, end);
+	for(; rangeTargets.first != rangeTargets.second; ++rangeTargets.first) {
+		const MazeTarget *target = rangeTargets.first->second;
 		require(nullptr != target, "Found nullptr target!");
-		require(false == target->visited(), "This target should have been not visited yet");
-		++rangeUnvisited.first; // to escape the invalidation triggered by next call
-		target->visit();
+		if(query.isPending(*target))
+			query.visit(*target);
 	}
 }
 
@@ -368,7 +439,7 @@ string Segment::toString() const {
 }
 
 void BranchlessPath::expand(const Coord &anEnd, bool horizDir, bool afterSeed/* = true*/) {
-	PSegmentsPair hvSegments = _coordOwners[anEnd];
+	PSegmentsPair hvSegments = _problem.ownersOf(anEnd);
 	Segment *seg = (horizDir ? hvSegments.first : hvSegments.second);
 	if(nullptr == seg)
 		return;
@@ -388,10 +459,9 @@ void BranchlessPath::expand(const Coord &anEnd, bool horizDir, bool afterSeed/*
 
 	// anEnd belongs for sure to *seg
 	if(false == seg->containsCoord(anEnd, true)) { // and one of its ends meets the provided anEnd
-		if(_orphanSegments.find(seg) != _orphanSegments.end()) {
+		if(false == seg->hasOwner()) { // orphan segment
 			// we found a new child:
 			seg->setOwner(this);
-			_orphanSegments.erase(seg);
 			(children.*listInsertMethod)(seg);
 			*endToUpdate = seg->otherEnd(anEnd);
 			expand(*endToUpdate, !horizDir, afterSeed);
@@ -411,18 +481,17 @@ BranchlessPath::LSI BranchlessPath::whichSegment(const Segment &seg) const {
 	return itEnd; // shouldn't be reachable
 }
 
-BranchlessPath::BranchlessPath(unsigned id, Segment &firstChild, set<Segment*> &orphanSegments, map<Coord, PSegmentsPair> &coordOwners) : _id(id), _orphanSegments(orphanSegments), _coordOwners(coordOwners) {
+BranchlessPath::BranchlessPath(unsigned id, Segment &firstChild, const ProblemAdapter &problem) : _id(id), _problem(problem) {
 	require(firstChild.hasOwner() == false, "Cannot create an BranchlessPath using a Segment that already belongs to an BranchlessPath!");
 	firstChild.setOwner(this);
 	ends = firstChild.ends();
-	_orphanSegments.erase(&firstChild);
 	children.push_back(&firstChild);
 	bool is1stChildHorizontal = firstChild.isHorizontal();
 	expand(ends.first, !is1stChildHorizontal, false);
 	expand(ends.second, !is1stChildHorizontal);
 }
 
-optional<BranchlessPath::LSI> BranchlessPath::lastUnvisited(const Coord *fromCoord/* = nullptr*/, const Coord *end/* = nullptr*/) const {
+optional<BranchlessPath::LSI> BranchlessPath::lastUnvisited(const MazeQuery &query, const Coord *fromCoord/* = nullptr*/, const Coord *end/* = nullptr*/) const {
 	bool nonNullFrom = (nullptr != fromCoord);
 	require((end != nullptr) == nonNullFrom, "From and end should be both either nullptr or valid pointers!");
 	if(false == nonNullFrom) {
@@ -447,18 +516,18 @@ optional<BranchlessPath::LSI> BranchlessPath::lastUnvisited(const Coord *fromCoo
 		segBegin = seg->otherEnd(segEnd)) {
 
 		segCoordNext2Begin = seg->nextToEnd(segBegin);
-		if(seg->hasUnvisitedTargets(&segCoordNext2Begin, &segEnd))
+		if(seg->hasUnvisitedTargets(query, &segCoordNext2Begin, &segEnd))
 			return itEnd;
 	}
 
-	if(seg->hasUnvisitedTargets(fromCoord, &segEnd))
+	if(seg->hasUnvisitedTargets(query, fromCoord, &segEnd))
 		return itEnd;
 
 	return optional<LSI>();
 }
 
 Segment* BranchlessPath::containsCoord(const Coord &coord) const {
-	PSegmentsPair hvSegments = _coordOwners[coord];
+	PSegmentsPair hvSegments = _problem.ownersOf(coord);
 	Segment *hSeg = hvSegments.first, *vSeg = hvSegments.second;
 	bool hFound = (nullptr != hSeg), vFound = (nullptr != vSeg);
 	require(hFound || vFound, "At least one segment should cover each Coord!");
@@ -493,7 +562,7 @@ Coord BranchlessPath::segEndWithinBranchlessPath(LSI it, bool towardsLowerPartOf
 	return (neighbour->containsCoord(lowerEnd) ? lowerEnd : self->upperEnd());
 }
 
-set<MazeTarget*> BranchlessPath::getUnvisitedTargets(const Coord *fromCoord/* = nullptr*/, const Coord *end/* = nullptr*/) const {
+set<const MazeTarget*> BranchlessPath::getUnvisitedTargets(const MazeQuery &query, const Coord *fromCoord/* = nullptr*/, const Coord *end/* = nullptr*/) const {
 	bool nonNullFrom = (nullptr != fromCoord);
 	require((end != nullptr) == nonNullFrom, "From and end should be both either nullptr or valid pointers!");
 
@@ -508,29 +577,29 @@ set<MazeTarget*> BranchlessPath::getUnvisitedTargets(const Coord *fromCoord/* =
 		swap(fromCoord, end);
 	}
 
-	set<MazeTarget*> result;
+	set<const MazeTarget*> result;
 	Coord segEnd;
 	LSI it = locateCoord(*fromCoord), itEnd = locateCoord(*end);
 
 	if(it == itEnd) { // if the path of interest contains only one segment
 		segEnd = segEndWithinBranchlessPath(it, firstEndAsEnd);
-		result = (*it)->getUnvisitedTargets(fromCoord, &segEnd);
+		result = (*it)->getUnvisitedTargets(query, fromCoord, &segEnd);
 
 		return result;
 	}
 
-	set<MazeTarget*> segTargets;
+	set<const MazeTarget*> segTargets;
 	segEnd = segEndWithinBranchlessPath(it, false);
-	segTargets = (*it)->getUnvisitedTargets(fromCoord, &segEnd);
+	segTargets = (*it)->getUnvisitedTargets(query, fromCoord, &segEnd);
 	result.insert(BOUNDS_OF(segTargets));
 
 	for(++it; it != itEnd; ++it) {
-		segTargets = (*it)->getUnvisitedTargets();
+		segTargets = (*it)->getUnvisitedTargets(query);
 		result.insert(BOUNDS_OF(segTargets));
 	}
 
 	segEnd = segEndWithinBranchlessPath(itEnd, true);
-	segTargets = (*it)->getUnvisitedTargets(end, &segEnd);
+	segTargets = (*it)->getUnvisitedTargets(query, end, &segEnd);
 	result.insert(BOUNDS_OF(segTargets));
 
 	return result;
@@ -556,11 +625,11 @@ void BranchlessPath::setLinksOwners() {
 		linksOwners.push_back(links.second->owner());
 }
 
-void BranchlessPath::traverse(const Coord &from, LSI itFrom, LSI itTo, bool towardsLowerPartOfBranchlessPath, std::shared_ptr<Maze::UiEngine> uiEngine) {
-	Segment *seg = *itFrom;
+void BranchlessPath::traverse(MazeQuery &query, const Coord &from, LSI itFrom, LSI itTo, bool towardsLowerPartOfBranchlessPath, std::shared_ptr<Maze::UiEngine> uiEngine) const {
+	const Segment *seg = *itFrom;
 	Coord segEnd = segEndWithinBranchlessPath(itFrom, towardsLowerPartOfBranchlessPath);
 	if(from != segEnd) {
-		seg->traverse(&from, &segEnd);
+		seg->traverse(query, &from, &segEnd);
 		uiEngine->drawMove(from, segEnd);
 	}
 
@@ -569,13 +638,13 @@ void BranchlessPath::traverse(const Coord &from, LSI itFrom, LSI itTo, bool towa
 			itTo != itFrom;
 			updateLSI(itFrom, towardsLowerPartOfBranchlessPath)) {
 			seg = *itFrom;
-			seg->traverse();
+			seg->traverse(query);
 			segEnd = seg->otherEnd(segEnd);
 			uiEngine->drawMove(seg->otherEnd(segEnd), segEnd);
 		}
 
 		seg = *itTo;
-		seg->traverse();
+		seg->traverse(query);
 		segEnd = seg->otherEnd(segEnd);
 		uiEngine->drawMove(seg->otherEnd(segEnd), segEnd);
 	}
@@ -588,7 +657,7 @@ void BranchlessPath::traverse(const Coord &from, LSI itFrom, LSI itTo, bool towa
 // 
 // The parameter stopAfterLastTarget can be used for the last target to finish the whole traversal
 // or when detouring to visit all the targets
-void BranchlessPath::traverse(const Coord &from, const Coord &end,
+void BranchlessPath::traverse(MazeQuery &query, const Coord &from, const Coord &end,
 
 							  std::shared_ptr<Maze::UiEngine> uiEngine,
 
@@ -598,7 +667,7 @@ void BranchlessPath::traverse(const Coord &from, const Coord &end,
 
 							  // set stopAfterLastTarget to true for the last traversal (with visitAllTargets == true)
 							  // or when detouring to visit all the targets (with visitAllTargets == false)
-							  bool stopAfterLastTarget/* = false*/) {
+							  bool stopAfterLastTarget/* = false*/) const {
 
 	Coord start = from, finish = end, theOtherEnd = otherEnd(finish);
 	LSI itStart = locateCoord(from), itFinish = locateCoord(finish);
@@ -606,10 +675,10 @@ void BranchlessPath::traverse(const Coord &from, const Coord &end,
 	bool isEndThe1stEnd = isFirstEnd(finish);
 
 	if(visitAllTargets)
-		oItLastUnvisitedOtherEnd = lastUnvisited(&start, &theOtherEnd);
+		oItLastUnvisitedOtherEnd = lastUnvisited(query, &start, &theOtherEnd);
 
 	if(stopAfterLastTarget)
-		oItLastUnvisitedEnd = lastUnvisited(&start, &finish);
+		oItLastUnvisitedEnd = lastUnvisited(query, &start, &finish);
 
 	if(stopAfterLastTarget && visitAllTargets) { // lastTraversal - provided end might be suboptimal
 		// traversedSegments = 2 * distanceToFarthestTargetOutOfTheWay + distanceToFarthestTargetOnTheWay
@@ -639,7 +708,7 @@ void BranchlessPath::traverse(const Coord &from, const Coord &end,
 	}
 
 	if(visitAllTargets && oItLastUnvisitedOtherEnd) {
-		traverse(from, itStart, *oItLastUnvisitedOtherEnd, !isEndThe1stEnd, uiEngine);
+		traverse(query, from, itStart, *oItLastUnvisitedOtherEnd, !isEndThe1stEnd, uiEngine);
 
 		itStart = *oItLastUnvisitedOtherEnd;
 		start = segEndWithinBranchlessPath(itStart, !isEndThe1stEnd);
@@ -650,18 +719,22 @@ void BranchlessPath::traverse(const Coord &from, const Coord &end,
 		finish = segEndWithinBranchlessPath(itFinish, isEndThe1stEnd);
 	}
 
-	traverse(start, itStart, itFinish, isEndThe1stEnd, uiEngine);
+	traverse(query, start, itStart, itFinish, isEndThe1stEnd, uiEngine);
 }
 
 string BranchlessPath::toString() const {
 	ostringstream oss;
 	oss<<"BranchlessPath "<<_id;
-	set<MazeTarget*> unvisitedTargets = getUnvisitedTargets();
-	if(unvisitedTargets.empty())
-		oss<<" (that has no unvisited targets)";
+	set<const MazeTarget*> pathTargets;
+	for(const auto seg : children) {
+		for(const auto &varDimTarget : seg->targets())
+			pathTargets.insert(varDimTarget.second);
+	}
+	if(pathTargets.empty())
+		oss<<" (that has no targets)";
 	else {
-		oss<<" (which contains "<<unvisitedTargets.size()<<" targets not visited yet: ";
-		for(auto t : unvisitedTargets) {
+		oss<<" (which contains "<<pathTargets.size()<<" targets: ";
+		for(auto t : pathTargets) {
 			oss<<(Coord)*t<<" ; ";
 		}
 		oss<<"\b\b)";
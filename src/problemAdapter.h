@@ -44,42 +44,41 @@ typedef std::pair<unsigned, unsigned> UUpair;
 // forward declarations
 class Segment;
 class BranchlessPath;
+class ProblemAdapter;
+class MazeQuery;
 
 typedef std::pair<Segment*, Segment*> PSegmentsPair; ///< Pair of pointers to segments
 
 /// The targets are special coordinates
 class MazeTarget: public Coord {
-	bool _visited;			///< was the target visited
-	PSegmentsPair visitors;	///< which of the 2 segments containing this target (horizontal and vertical) has been used to traverse this cell
+	unsigned _idx;			///< index of this target within ProblemAdapter::getTargets()
+	PSegmentsPair visitors;	///< the 1..2 segments (horizontal and vertical) containing this target
 
 public:
-	MazeTarget(unsigned row = UINT_MAX, unsigned col = UINT_MAX) : Coord(row, col), _visited(false) {}
-	MazeTarget(const Coord &c) : Coord(c.row, c.col), _visited(false) {}
+	MazeTarget(const Coord &c, unsigned idx = UINT_MAX) : Coord(c.row, c.col), _idx(idx) {}
 
-	/// Lets the target know which of the horizontal / vertical segments were used when visiting it
-	void setVisitors(PSegmentsPair &theVisitors) { visitors = theVisitors; }
-	void visit(); ///< Let the visitor (horizontal and/or vertical) segments mark this target as visited
-	inline bool visited() const { return _visited; }
+	/// Lets the target know which of the horizontal / vertical segments contain it
+	void setVisitors(const PSegmentsPair &theVisitors) { visitors = theVisitors; }
+	inline unsigned idx() const { return _idx; }
 	inline bool isShared() const { return (visitors.first != nullptr) && (visitors.second != nullptr); }
 };
 
 /// Traversable segment of the maze (wall to wall)
 class Segment {
 	/// Mapping between segment coordinates (the variable 1D coordinates) and target objects
-	typedef std::map<unsigned, MazeTarget*> UTargetMap;
-	typedef std::pair<UTargetMap::const_iterator, UTargetMap::const_iterator> RangeUnvisited;
+	typedef std::map<unsigned, const MazeTarget*> UTargetMap;
+	typedef std::pair<UTargetMap::const_iterator, UTargetMap::const_iterator> RangeTargets;
 
 	bool _isHorizontal;		///< is this a horizontal or vertical segment
 	unsigned fixedIndex;	///< for horizontal segments, the 'row' coordinate is fixed; for vertical ones, the 'column' is fixed
 	boost::icl::closed_interval<unsigned>::type closedInterval;	///< the limit 1D coordinates for the non-fixed part of the 2D coordinate
 
-	std::vector<MazeTarget*> managedTargets;		///< the targets lying on this segment
-	mutable UTargetMap varDimUnvisitedTargets;	///< the map between the segment coordinates of unvisited targets and these targets (the key is the variable 1D coordinate of the target on the segment)
+	UTargetMap varDimTargets;	///< the map between the segment coordinates of its targets and these targets (the key is the variable 1D coordinate of the target on the segment)
 
 	BranchlessPath *parent;	///< the path (graph vertex) containing this segment
 
-	/// @return a map of unvisited targets between the 2 coordinates found on a horizontal / vertical line
-	RangeUnvisited unvisitedTargets(const Coord *from = nullptr, const Coord *end = nullptr) const;
+	/// @return the range of targets (visited or not) between the 2 coordinates found on a horizontal / vertical line
+	RangeTargets targetsBetween(const Coord *from = nullptr, const Coord *end = nullptr) const;
 
 public:
 
@@ -135,18 +134,18 @@ public:
 	/// @return the neighbor (from inside the segment) of the end of this segment
 	Coord nextToEnd(const Coord &end) const;
 
-	bool hasUnvisitedTargets(const Coord *from = nullptr, const Coord *end = nullptr) const;
+	bool hasUnvisitedTargets(const MazeQuery &query, const Coord *from = nullptr, const Coord *end = nullptr) const;
 
-	std::set<MazeTarget*> getUnvisitedTargets(const Coord *from = nullptr, const Coord *end = nullptr) const;
+	std::set<const MazeTarget*> getUnvisitedTargets(const MazeQuery &query, const Coord *from = nullptr, const Coord *end = nullptr) const;
 
-	/// The segment becomes aware of a certain target found on itself
-	void manageTarget(MazeTarget &target);
+	/// @return all the targets lying on this segment, no matter the query
+	inline const UTargetMap& targets() const { return varDimTargets; }
 
-	/// The segment should know that the target provided as parameter (lying on this segment) was visited
-	void ackVisit(const MazeTarget &target);
+	/// The segment becomes aware of a certain target found on itself
+	void manageTarget(const MazeTarget &target);
 
-	/// This segment is visited between from and end. Provide either both or none of these parameters.
-	void traverse(const Coord *from = nullptr, const Coord *end = nullptr);
+	/// This segment is visited between from and end within query. Provide either both or none of these coordinates.
+	void traverse(MazeQuery &query, const Coord *from = nullptr, const Coord *end = nullptr) const;
 
 	inline bool hasOwner() const { return nullptr != parent; }
 	inline BranchlessPath* owner() const { return parent; }
@@ -179,8 +178,7 @@ class BranchlessPath {
 	std::vector<BranchlessPath*> linksOwners; ///< the BranchlessPath to which the links above belong (connected vertices in the graph representing the maze)
 
 	std::list<Segment*> children; ///< all segments forming this path (graph vertex) placed around the path seed - the first child segment
-	std::set<Segment*> &_orphanSegments;
-	std::map<Coord, PSegmentsPair> &_coordOwners;
+	const ProblemAdapter &_problem;	///< the maze containing this path
 
 	/// Expand the path (graph vertex) adding the new segment from 'anEnd' either to the front, or to the back of children
 	void expand(const Coord &anEnd, bool horizDir, bool afterSeed = true);
@@ -192,7 +190,7 @@ class BranchlessPath {
 	inline void updateLSI(LSI &it, bool towardsLowerPartOfBranchlessPath) const;
 
 	/// @return iterator to the first unvisited target while following in reverse order the path between the provided coordinates
-	boost::optional<LSI> lastUnvisited(const Coord *fromCoord = NULL, const Coord *end = NULL) const;
+	boost::optional<LSI> lastUnvisited(const MazeQuery &query, const Coord *fromCoord = NULL, const Coord *end = NULL) const;
 
 	/// @return iterator within children pointing to the segment containing 'coord'
 	LSI locateCoord(const Coord &coord) const;
@@ -206,15 +204,16 @@ class BranchlessPath {
 	- in the direction specified by 'towardsLowerPartOfBranchlessPath'
 	- until reaching the segment pointed by 'itTo'
 	*/
-	void traverse(const Coord &from, LSI itFrom, LSI itTo, bool towardsLowerPartOfBranchlessPath,
-				  std::shared_ptr<Maze::UiEngine> uiEngine);
-
-	/// Discover which other 0..2 paths (graph vertices) are connected to this path (through its 2 ends)
-	void setLinksOwners();
+	void traverse(MazeQuery &query, const Coord &from, LSI itFrom, LSI itTo, bool towardsLowerPartOfBranchlessPath,
+				  std::shared_ptr<Maze::UiEngine> uiEngine) const;
 
 public:
 	/// Initialize a path with a seed segment which should expand as long as there are no bifurcations
-	BranchlessPath(unsigned id, Segment &firstChild, std::set<Segment*> &orphanSegments, std::map<Coord, PSegmentsPair> &coordOwners);
+	BranchlessPath(unsigned id, Segment &firstChild, const ProblemAdapter &problem);
+
+	/// Discover which other 0..2 paths (graph vertices) are connected to this path (through its 2 ends).
+	/// Called once all paths were created, so that the path remains read-only afterwards
+	void setLinksOwners();
 
 	inline unsigned id() const { return _id; }
 
@@ -238,10 +237,7 @@ public:
 		return links;
 	}
 
-	inline const std::vector<BranchlessPath*> theLinksOwners() const {
-		if(linksOwners.empty())
-			(const_cast<BranchlessPath*>(this))->setLinksOwners();
-
+	inline const std::vector<BranchlessPath*>& theLinksOwners() const {
 		return linksOwners;
 	}
 
@@ -285,13 +281,13 @@ public:
 		return ends;
 	}
 
-	/// @return true if there are unvisited targets between the provided coordinates
-	inline bool hasUnvisitedTargets(const Coord *fromCoord = NULL, const Coord *end = NULL) const {
-		return lastUnvisited(fromCoord, end).is_initialized();
+	/// @return true if there are unvisited targets (within query) between the provided coordinates
+	inline bool hasUnvisitedTargets(const MazeQuery &query, const Coord *fromCoord = NULL, const Coord *end = NULL) const {
+		return lastUnvisited(query, fromCoord, end).is_initialized();
 	}
 
-	/// @return the unvisited targets between the provided coordinates
-	std::set<MazeTarget*> getUnvisitedTargets(const Coord *fromCoord = NULL, const Coord *end = NULL) const;
+	/// @return the unvisited targets (within query) between the provided coordinates
+	std::set<const MazeTarget*> getUnvisitedTargets(const MazeQuery &query, const Coord *fromCoord = NULL, const Coord *end = NULL) const;
 
 	/// @return does 'segToFind' belong to this path (graph vertex)?
 	inline bool containsSegment(const Segment &segToFind) const {
@@ -313,8 +309,8 @@ public:
 	Set stopAfterLastTarget to true for the last traversal (with visitAllTargets == true)
 	or when detouring to visit all the targets (with visitAllTargets == false)
 	*/
-	void traverse(const Coord &from, const Coord &end, std::shared_ptr<Maze::UiEngine> uiEngine,
-				  bool visitAllTargets = false, bool stopAfterLastTarget = false);
+	void traverse(MazeQuery &query, const Coord &from, const Coord &end, std::shared_ptr<Maze::UiEngine> uiEngine,
+				  bool visitAllTargets = false, bool stopAfterLastTarget = false) const;
 
 	std::string toString() const;
 
@@ -328,18 +324,18 @@ who needs all targets be covered before getting to it
 */
 class BpVertexProps {
 	unsigned _maxUnvisitedTargets; ///< gets set to 0 ONLY for the auxiliary added sink BP
-	BranchlessPath *_forTiltedMaze;	///< the BranchlessPath corresponding to this graph vertex
+	const BranchlessPath *_forTiltedMaze;	///< the BranchlessPath corresponding to this graph vertex
 
 public:
 	int num; ///< vertex id
 
 	/// default constructible expected
-	BpVertexProps(int n = 0, BranchlessPath *correspondingBP = nullptr, unsigned maxUnvisited = UINT_MAX) :
+	BpVertexProps(int n = 0, const BranchlessPath *correspondingBP = nullptr, unsigned maxUnvisited = UINT_MAX) :
 		num(n), _forTiltedMaze(correspondingBP), _maxUnvisitedTargets(maxUnvisited) {}
 
 	inline unsigned maxUnvisitedTargets() const { return _maxUnvisitedTargets; }
 
-	inline BranchlessPath* forTiltedMaze() const { return _forTiltedMaze; }
+	inline const BranchlessPath* forTiltedMaze() const { return _forTiltedMaze; }
 
 	std::string toString() const;
 
@@ -359,54 +355,123 @@ struct BpsArcProps {
 typedef boost::adjacency_list< boost::vecS, boost::vecS, boost::directedS, BpVertexProps, BpsArcProps >
 	BpAdjacencyList;
 
+/// Keeps the location of all targets within the BranchlessPath-s and assesses the effects of some moves
+class Targets {
+	typedef std::map< const MazeTarget*, std::set< const BranchlessPath* > >  TargetBpMapping;
+
+	TargetBpMapping initialTargetBpMapping; ///< location of the targets within BranchlessPath-s (graph vertices)
+
+public:
+	void clear() { initialTargetBpMapping.clear(); }
+
+	/// Registers a target covered by a single BranchlessPath (graph vertex)
+	void addTarget(const MazeTarget &t, const BranchlessPath &ownerBp);
+
+	/// version ONLY for targets SHARED by idx1stSharer and idx2ndSharer
+	void addTarget(const MazeTarget &t, const BranchlessPath &sharerBp1, const BranchlessPath &sharerBp2);
+
+	/// @return the number of required targets (see MazeTarget::idx()) remaining unvisited after any walk that covers the BPs within traversedBps
+	/// If parameter unvisitedTargets != nullptr, it copies the remaining unvisited targets into it.
+	/// It's called for every label extension and dominance check, so it doesn't allocate anything
+	unsigned unvisited(const std::set<const BranchlessPath*> &traversedBps,
+					   const std::vector<bool> &requiredTargets,
+					   std::set<const MazeTarget*> *unvisitedTargets = nullptr) const;
+};
+
 /**
 ProblemAdapter:
 - receives a basic Maze object
 - transforms it into a graph
 - provides the graph to the solver
+
+Once built, it remains read-only, so a single instance (held by a shared_ptr) can serve concurrently
+several queries (MazeQuery) - for instance from different threads, with different starts or subsets of targets.
 */
 class ProblemAdapter {
-	std::shared_ptr<Maze> maze;
+	std::shared_ptr<const Maze> maze;
 
 	std::vector<MazeTarget> targets;	///< required targets to be visited
 
 	std::vector<Segment> hSegments;		///< horizontal segments
 	std::vector<Segment> vSegments;		///< vertical segments
-	std::set<Segment*> orphanSegments; ///< before grouping the segments into paths (without bifurcations) they are considered orphans
-	std::map<Coord, PSegmentsPair> coordOwners;	///< 1..2 (horizontal and/or vertical) segments containing a certain coordinate
+	std::vector<PSegmentsPair> coordOwners;	///< 0..2 (horizontal and/or vertical) segments containing each coordinate (index = row * columnsCount + col)
 	std::vector<std::shared_ptr<BranchlessPath>> branchlessPaths; ///< the (non-bifurcated) paths (graph vertices)
+	Targets graphTargets;	///< location of the targets within the branchlessPaths
 	BpAdjacencyList searchGraph;
 
 	void buildGraph(bool verbose = false);
 
+	// The segments and paths point to each other, so copying is forbidden
+	ProblemAdapter(const ProblemAdapter&) = delete;
+	ProblemAdapter& operator=(const ProblemAdapter&) = delete;
+
 public:
-	ProblemAdapter(std::shared_ptr<Maze> aMaze, bool verbose = false);
+	ProblemAdapter(std::shared_ptr<const Maze> aMaze, bool verbose = false);
 
-	inline const std::shared_ptr<Maze>& getMaze() const { return maze; }
+	inline const std::shared_ptr<const Maze>& getMaze() const { return maze; }
 	inline const std::vector<MazeTarget>& getTargets() const { return targets; }
 	inline const std::vector<std::shared_ptr<BranchlessPath>>& getBranchlessPaths() const { return branchlessPaths; }
+	inline const Targets& getGraphTargets() const { return graphTargets; }
 	inline const BpAdjacencyList& getSearchGraph() const { return searchGraph; }
+
+	/// The auxiliary vertex linked to every BP. MazeQuery decides which of these links are feasible
+	inline size_t idxStartVertex() const { return branchlessPaths.size(); }
+
+	/// The auxiliary sink vertex, reachable only after visiting all required targets
+	inline size_t idxEndVertex() const { return branchlessPaths.size() + 1ULL; }
+
+	/// @return the 0..2 (horizontal and/or vertical) segments containing coord
+	PSegmentsPair ownersOf(const Coord &coord) const;
+
+	/// @return the target from coord or nullptr if there's no target there
+	const MazeTarget* targetAt(const Coord &coord) const;
 };
 
-/// Keeps the visiting evidence for all targets and assesses the effects of some moves
-class Targets {
-	typedef std::map< MazeTarget*, std::set< BranchlessPath* > >  TargetBpMapping;
+/**
+MazeQuery - the cheap, mutable counterpart of a shared ProblemAdapter:
+- the start location and the targets required by this query
+- the visiting evidence of those targets while traversing a solution
 
-	TargetBpMapping initialTargetBpMapping; ///< location of the targets within BranchlessPath-s (graph vertices)
+Each thread should use its own MazeQuery-s, while the ProblemAdapter may be shared among them.
+*/
+class MazeQuery {
+	std::shared_ptr<const ProblemAdapter> problem;	///< the shared read-only maze and its graph
+
+	Coord _startLocation;			///< where the token starts for this query
+	std::vector<bool> required;		///< which targets (by MazeTarget::idx()) must be visited within this query
+	std::vector<bool> pending;		///< which required targets (by MazeTarget::idx()) weren't visited yet during the traversal
+	std::vector<unsigned> startBps;	///< ids of the 0..2 BranchlessPath-s containing the start location
+
+	void init();
 
 public:
-	void clear() { initialTargetBpMapping.clear(); }
+	/// Query using the start location and all targets of the maze
+	MazeQuery(std::shared_ptr<const ProblemAdapter> aProblem);
 
-	/// Registers a target covered by a single BranchlessPath (graph vertex)
-	void addTarget(MazeTarget &t, BranchlessPath &ownerBp);
+	/// Query using a different start location and / or a subset of the targets of the maze
+	MazeQuery(std::shared_ptr<const ProblemAdapter> aProblem, const Coord &startLocation,
+			  const std::vector<Coord> &targetsSubset);
 
-	/// version ONLY for targets SHARED by idx1stSharer and idx2ndSharer
-	void addTarget(MazeTarget &t, BranchlessPath &sharerBp1, BranchlessPath &sharerBp2);
+	inline const std::shared_ptr<const ProblemAdapter>& getProblem() const { return problem; }
+	inline const Coord& startLocation() const { return _startLocation; }
+	inline const std::vector<bool>& requiredTargets() const { return required; }
+
+	/// @return true if bp contains the start location, so the walk may begin with it
+	bool isStartBp(const BranchlessPath &bp) const;
 
-	/// @return the number of unvisited targets remaining after any walk that covers the BPs within traversedBps
-	/// If parameter unvisitedTargets != nullptr, it copies the remaining unvisited targets into it
-	unsigned unvisited(const std::set<BranchlessPath*> &traversedBps,
-					   std::set<MazeTarget*> *unvisitedTargets = nullptr) const;
+	inline bool isRequired(const MazeTarget &t) const { return required[t.idx()]; }
+	inline bool isPending(const MazeTarget &t) const { return pending[t.idx()]; }
+
+	/// @return true when all required targets were visited during the traversal
+	bool allTargetsVisited() const;
+
+	void visit(const MazeTarget &t);	///< Marks the target as visited during the traversal
+	void resetVisits();					///< Prepares the query for a new traversal
+
+	/// @return the number of required targets remaining unvisited after any walk that covers the BPs within traversedBps
+	inline unsigned unvisited(const std::set<const BranchlessPath*> &traversedBps) const {
+		return problem->getGraphTargets().unvisited(traversedBps, required);
+	}
 };
 
 #endif // H_PROBLEM_ADAPTER
\ No newline at end of file